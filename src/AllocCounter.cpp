@@ -0,0 +1,65 @@
+#include "AllocCounter.h"
+
+#include <cstdlib>
+#include <new>
+
+#if defined(COUNT_ALLOCS) and COUNT_ALLOCS == 1
+static thread_local unsigned long long threadAllocs = 0;
+
+static void * CountedAlloc(std::size_t size) {
+	threadAllocs++;
+	return std::malloc(size == 0 ? 1 : size);
+}
+
+void * operator new(std::size_t size) {
+	void * ptr = CountedAlloc(size);
+	if (ptr == NULL) {
+		throw std::bad_alloc();
+	}
+	return ptr;
+}
+
+void * operator new[](std::size_t size) {
+	void * ptr = CountedAlloc(size);
+	if (ptr == NULL) {
+		throw std::bad_alloc();
+	}
+	return ptr;
+}
+
+void * operator new(std::size_t size, const std::nothrow_t&) noexcept {
+	return CountedAlloc(size);
+}
+
+void * operator new[](std::size_t size, const std::nothrow_t&) noexcept {
+	return CountedAlloc(size);
+}
+
+void operator delete(void * ptr) noexcept {
+	std::free(ptr);
+}
+
+void operator delete[](void * ptr) noexcept {
+	std::free(ptr);
+}
+
+void operator delete(void * ptr, const std::nothrow_t&) noexcept {
+	std::free(ptr);
+}
+
+void operator delete[](void * ptr, const std::nothrow_t&) noexcept {
+	std::free(ptr);
+}
+#endif
+
+namespace trickfire {
+
+unsigned long long AllocCounter::GetThreadAllocs() {
+#if defined(COUNT_ALLOCS) and COUNT_ALLOCS == 1
+	return threadAllocs;
+#else
+	return 0;
+#endif
+}
+
+}
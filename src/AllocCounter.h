@@ -0,0 +1,29 @@
+#ifndef ALLOCCOUNTER_H_
+#define ALLOCCOUNTER_H_
+
+// Build with -DCOUNT_ALLOCS=1 to replace the global operator new and record
+// the alloc.* profiler counters, left off so normal builds keep the default
+// allocator
+#ifndef COUNT_ALLOCS
+#define COUNT_ALLOCS 0
+#endif
+
+namespace trickfire {
+
+/**
+ * Counts heap allocations made through operator new on the calling thread, so
+ * steady state code paths can be checked for allocations. Always 0 when
+ * COUNT_ALLOCS is off.
+ */
+class AllocCounter {
+public:
+	static unsigned long long GetThreadAllocs();
+
+	static inline bool IsEnabled() {
+		return COUNT_ALLOCS == 1;
+	}
+};
+
+}
+
+#endif
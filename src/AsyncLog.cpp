@@ -0,0 +1,191 @@
+#include "AsyncLog.h"
+
+#include <cctype>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+
+namespace trickfire {
+
+std::atomic<AsyncLog::Level> AsyncLog::minLevel(AsyncLog::LEVEL_INFO);
+std::atomic<bool> AsyncLog::running(false);
+sf::Clock AsyncLog::clock;
+thread_local AsyncLog::Ring * AsyncLog::localRing = NULL;
+std::vector<AsyncLog::Ring *> AsyncLog::rings;
+std::vector<AsyncLog::Ring *> AsyncLog::drainRings;
+sf::Mutex AsyncLog::mutex_rings;
+sf::Thread AsyncLog::writerThread(&AsyncLog::WriterLoop);
+std::ostream * AsyncLog::out = &std::clog;
+
+static const char * const levelNames[] = { "TRACE", "DEBUG", "INFO", "WARN",
+		"ERROR", "OFF" };
+
+void AsyncLog::Start(const std::string& file) {
+	if (running) {
+		return;
+	}
+
+	if (!file.empty()) {
+		std::ofstream * stream = new std::ofstream(file.c_str(),
+				std::ios::out | std::ios::app);
+		if (stream->is_open()) {
+			out = stream;
+		} else {
+			delete stream;
+			std::cerr << "Failed to open log file " << file << std::endl;
+		}
+	}
+
+	running = true;
+	writerThread.launch();
+}
+
+void AsyncLog::Stop() {
+	if (!running) {
+		return;
+	}
+
+	running = false;
+	writerThread.wait();
+
+	// Pick up anything logged while the writer was shutting down
+	while (Drain()) {
+	}
+
+	unsigned long long dropped = GetDropped();
+	if (dropped > 0) {
+		*out << "AsyncLog dropped " << dropped << " records" << std::endl;
+	}
+	out->flush();
+
+	if (out != &std::clog) {
+		delete out;
+		out = &std::clog;
+	}
+}
+
+void AsyncLog::SetLevel(Level level) {
+	minLevel.store(level, std::memory_order_relaxed);
+}
+
+bool AsyncLog::ParseLevel(const std::string& name, Level& level) {
+	std::string upper = name;
+	for (unsigned int i = 0; i < upper.size(); i++) {
+		upper[i] = toupper(upper[i]);
+	}
+
+	for (int i = LEVEL_TRACE; i <= LEVEL_OFF; i++) {
+		if (upper == levelNames[i]) {
+			level = (Level) i;
+			return true;
+		}
+	}
+	return false;
+}
+
+unsigned long long AsyncLog::GetDropped() {
+	sf::Lock lock(mutex_rings);
+	unsigned long long total = 0;
+	for (unsigned int i = 0; i < rings.size(); i++) {
+		total += rings[i]->dropped.load(std::memory_order_relaxed);
+	}
+	return total;
+}
+
+void AsyncLog::Push(const Record& record) {
+	Ring * ring = localRing;
+	if (ring == NULL) {
+		ring = localRing = RegisterRing();
+	}
+
+	unsigned int head = ring->head.load(std::memory_order_relaxed);
+	unsigned int tail = ring->tail.load(std::memory_order_acquire);
+	if (head - tail >= LOG_RING_SIZE) {
+		// Never block the caller, just count what we lost
+		ring->dropped.fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
+
+	ring->records[head & (LOG_RING_SIZE - 1)] = record;
+	ring->head.store(head + 1, std::memory_order_release);
+}
+
+AsyncLog::Ring * AsyncLog::RegisterRing() {
+	// Only happens once per thread, so a lock here is fine
+	Ring * ring = new Ring();
+	ring->head = 0;
+	ring->tail = 0;
+	ring->dropped = 0;
+
+	sf::Lock lock(mutex_rings);
+	rings.push_back(ring);
+	return ring;
+}
+
+bool AsyncLog::Drain() {
+	bool wrote = false;
+
+	// Only hold the lock long enough to see which rings exist, so threads
+	// registering a ring never wait on the stream
+	mutex_rings.lock();
+	drainRings.assign(rings.begin(), rings.end());
+	mutex_rings.unlock();
+
+	for (unsigned int i = 0; i < drainRings.size(); i++) {
+		Ring * ring = drainRings[i];
+		unsigned int tail = ring->tail.load(std::memory_order_relaxed);
+		unsigned int head = ring->head.load(std::memory_order_acquire);
+		while (tail != head) {
+			Write(ring->records[tail & (LOG_RING_SIZE - 1)]);
+			tail++;
+			ring->tail.store(tail, std::memory_order_release);
+			wrote = true;
+		}
+	}
+
+	return wrote;
+}
+
+void AsyncLog::Write(const Record& record) {
+	char stamp[32];
+	snprintf(stamp, sizeof(stamp), "[%12.6f] %-5s ", record.time / 1000000.0,
+			levelNames[record.level]);
+	*out << stamp;
+
+	unsigned int arg = 0;
+	for (const char * c = record.format; *c != '\0'; c++) {
+		if (c[0] == '{' && c[1] == '}' && arg < record.argCount) {
+			const Arg& a = record.args[arg++];
+			switch (a.type) {
+			case Arg::TYPE_INT:
+				*out << a.i;
+				break;
+			case Arg::TYPE_UINT:
+				*out << a.u;
+				break;
+			case Arg::TYPE_DOUBLE:
+				*out << a.d;
+				break;
+			case Arg::TYPE_STRING:
+				*out << (a.s != NULL ? a.s : "(null)");
+				break;
+			}
+			c++;
+		} else {
+			*out << *c;
+		}
+	}
+
+	*out << '\n';
+}
+
+void AsyncLog::WriterLoop() {
+	while (running) {
+		if (!Drain()) {
+			out->flush();
+			sf::sleep(sf::milliseconds(5));
+		}
+	}
+}
+
+}
@@ -0,0 +1,155 @@
+#ifndef ASYNCLOG_H_
+#define ASYNCLOG_H_
+
+// Records buffered per producer thread, must be a power of two
+#define LOG_RING_SIZE 1024
+#define LOG_MAX_ARGS 4
+
+#include <atomic>
+#include <string>
+#include <vector>
+#include <ostream>
+#include <SFML/System.hpp>
+
+namespace trickfire {
+
+/**
+ * Asynchronous logger for use on latency sensitive threads. Producers copy a
+ * fixed-size record into their own lock-free ring and return immediately;
+ * formatting and writing happens on a background thread.
+ *
+ * Formats use {} as the argument placeholder. String arguments are stored by
+ * pointer, so only pass string literals or other strings that outlive the
+ * program.
+ */
+class AsyncLog {
+public:
+	enum Level {
+		LEVEL_TRACE, LEVEL_DEBUG, LEVEL_INFO, LEVEL_WARNING, LEVEL_ERROR, LEVEL_OFF
+	};
+
+	static void Start(const std::string& file = "");
+	static void Stop();
+
+	static void SetLevel(Level level);
+	static bool ParseLevel(const std::string& name, Level& level);
+	static unsigned long long GetDropped();
+
+	static inline bool IsEnabled(Level level) {
+		return level >= minLevel.load(std::memory_order_relaxed);
+	}
+
+	template<typename ... Args>
+	static inline void Log(Level level, const char * format, Args ... args) {
+		static_assert(sizeof...(Args) <= LOG_MAX_ARGS,
+				"Too many log arguments, raise LOG_MAX_ARGS");
+		if (!IsEnabled(level)) {
+			return;
+		}
+
+		Record record;
+		record.level = level;
+		record.format = format;
+		record.argCount = 0;
+		record.time = clock.getElapsedTime().asMicroseconds();
+		Pack(record, args...);
+		Push(record);
+	}
+
+private:
+	struct Arg {
+		enum Type {
+			TYPE_INT, TYPE_UINT, TYPE_DOUBLE, TYPE_STRING
+		} type;
+		union {
+			long long i;
+			unsigned long long u;
+			double d;
+			const char * s;
+		};
+	};
+
+	struct Record {
+		Level level;
+		const char * format;
+		unsigned int argCount;
+		sf::Int64 time;
+		Arg args[LOG_MAX_ARGS];
+	};
+
+	// Single producer (the owning thread), single consumer (the writer)
+	struct Ring {
+		Record records[LOG_RING_SIZE];
+		std::atomic<unsigned int> head;
+		std::atomic<unsigned int> tail;
+		std::atomic<unsigned long long> dropped;
+	};
+
+	static std::atomic<Level> minLevel;
+	static std::atomic<bool> running;
+	static sf::Clock clock;
+	static thread_local Ring * localRing;
+	static std::vector<Ring *> rings;
+	static std::vector<Ring *> drainRings;
+	static sf::Mutex mutex_rings;
+	static sf::Thread writerThread;
+	static std::ostream * out;
+
+	static inline void Pack(Record&) {
+	}
+
+	template<typename T, typename ... Rest>
+	static inline void Pack(Record& record, T first, Rest ... rest) {
+		if (record.argCount < LOG_MAX_ARGS) {
+			SetArg(record.args[record.argCount++], first);
+		}
+		Pack(record, rest...);
+	}
+
+	static inline void SetArg(Arg& arg, bool value) {
+		arg.type = Arg::TYPE_INT;
+		arg.i = value;
+	}
+	static inline void SetArg(Arg& arg, int value) {
+		arg.type = Arg::TYPE_INT;
+		arg.i = value;
+	}
+	static inline void SetArg(Arg& arg, long value) {
+		arg.type = Arg::TYPE_INT;
+		arg.i = value;
+	}
+	static inline void SetArg(Arg& arg, long long value) {
+		arg.type = Arg::TYPE_INT;
+		arg.i = value;
+	}
+	static inline void SetArg(Arg& arg, unsigned int value) {
+		arg.type = Arg::TYPE_UINT;
+		arg.u = value;
+	}
+	static inline void SetArg(Arg& arg, unsigned long value) {
+		arg.type = Arg::TYPE_UINT;
+		arg.u = value;
+	}
+	static inline void SetArg(Arg& arg, unsigned long long value) {
+		arg.type = Arg::TYPE_UINT;
+		arg.u = value;
+	}
+	static inline void SetArg(Arg& arg, double value) {
+		arg.type = Arg::TYPE_DOUBLE;
+		arg.d = value;
+	}
+	static inline void SetArg(Arg& arg, const char * value) {
+		arg.type = Arg::TYPE_STRING;
+		arg.s = value;
+	}
+
+	static void Push(const Record& record);
+	static Ring * RegisterRing();
+	static bool Drain();
+	static void Write(const Record& record);
+	static void WriterLoop();
+};
+
+}
+
+#endif
@@ -0,0 +1,150 @@
+#include "CameraAtlas.h"
+
+#include <algorithm>
+
+#include "AsyncLog.h"
+
+namespace trickfire {
+
+CameraAtlas::CameraAtlas() :
+		vertices(sf::Quads, 0), created(false), slotWidth(0), slotHeight(0), slotColumns(
+				1) {
+	for (int i = 0; i < CAM_COUNT; i++) {
+		hasFrame[i] = false;
+	}
+}
+
+bool CameraAtlas::Update(int cam, const cv::Mat& rgba) {
+	if (cam < 0 || cam >= CAM_COUNT || rgba.empty()) {
+		return false;
+	}
+
+	if (!created && !Create()) {
+		return false;
+	}
+
+	if ((unsigned int) rgba.cols > slotWidth
+			|| (unsigned int) rgba.rows > slotHeight || !rgba.isContinuous()) {
+		AsyncLog::Log(AsyncLog::LEVEL_WARNING,
+				"Camera {} frame {}x{} doesn't fit its atlas slot", cam,
+				rgba.cols, rgba.rows);
+		return false;
+	}
+
+	sf::Vector2u origin = SlotOrigin(cam);
+	texture.update(rgba.ptr(), rgba.cols, rgba.rows, origin.x, origin.y);
+	frameSize[cam] = sf::Vector2u(rgba.cols, rgba.rows);
+	hasFrame[cam] = true;
+	lastFrame[cam].restart();
+	return true;
+}
+
+bool CameraAtlas::IsActive(int cam) const {
+	return hasFrame[cam]
+			&& lastFrame[cam].getElapsedTime().asSeconds() < CAM_TIMEOUT;
+}
+
+int CameraAtlas::GetActiveCount() const {
+	int count = 0;
+	for (int i = 0; i < CAM_COUNT; i++) {
+		if (IsActive(i)) {
+			count++;
+		}
+	}
+	return count;
+}
+
+void CameraAtlas::Layout(const sf::FloatRect& primary,
+		const sf::FloatRect& secondary) {
+	vertices.clear();
+
+	// The first active feed gets the primary area, the rest share the
+	// secondary area side by side
+	int active = GetActiveCount();
+	int placed = 0;
+	for (int i = 0; i < CAM_COUNT; i++) {
+		if (!IsActive(i)) {
+			continue;
+		}
+
+		if (placed == 0) {
+			AppendFeed(i, primary);
+		} else {
+			float width = secondary.width / (active - 1);
+			AppendFeed(i,
+					sf::FloatRect(secondary.left + width * (placed - 1),
+							secondary.top, width, secondary.height));
+		}
+		placed++;
+	}
+}
+
+void CameraAtlas::Draw(sf::RenderWindow& window) const {
+	if (created && vertices.getVertexCount() > 0) {
+		window.draw(vertices, sf::RenderStates(&texture));
+	}
+}
+
+bool CameraAtlas::Create() {
+	slotWidth = CameraIngest::GetMaxCols();
+	slotHeight = CameraIngest::GetMaxRows();
+
+	// Pick the grid that fits the GPU limit while wasting the least space
+	unsigned int maxSize = sf::Texture::getMaximumSize();
+	unsigned int bestArea = 0;
+	for (unsigned int columns = 1; columns <= CAM_COUNT; columns++) {
+		unsigned int rows = (CAM_COUNT + columns - 1) / columns;
+		unsigned int width = columns * slotWidth;
+		unsigned int height = rows * slotHeight;
+		if (width <= maxSize && height <= maxSize
+				&& (bestArea == 0 || width * height < bestArea)) {
+			bestArea = width * height;
+			slotColumns = columns;
+		}
+	}
+
+	unsigned int slotRows = (CAM_COUNT + slotColumns - 1) / slotColumns;
+	if (bestArea == 0
+			|| !texture.create(slotColumns * slotWidth, slotRows * slotHeight)) {
+		AsyncLog::Log(AsyncLog::LEVEL_ERROR,
+				"Failed to create {}x{} camera atlas (max texture size {})",
+				slotColumns * slotWidth, slotRows * slotHeight, maxSize);
+		return false;
+	}
+
+	created = true;
+	return true;
+}
+
+sf::Vector2u CameraAtlas::SlotOrigin(int cam) const {
+	return sf::Vector2u((cam % slotColumns) * slotWidth,
+			(cam / slotColumns) * slotHeight);
+}
+
+void CameraAtlas::AppendFeed(int cam, const sf::FloatRect& area) {
+	sf::Vector2u size = frameSize[cam];
+
+	// Fit the feed inside the area without stretching it
+	float scale = std::min(area.width / size.x, area.height / size.y);
+	float width = size.x * scale;
+	float height = size.y * scale;
+	float left = area.left + (area.width - width) / 2;
+	float top = area.top;
+
+	sf::Vector2u origin = SlotOrigin(cam);
+	float u = origin.x, v = origin.y;
+
+	vertices.append(
+			sf::Vertex(sf::Vector2f(left, top), sf::Vector2f(u, v)));
+	vertices.append(
+			sf::Vertex(sf::Vector2f(left + width, top),
+					sf::Vector2f(u + size.x, v)));
+	vertices.append(
+			sf::Vertex(sf::Vector2f(left + width, top + height),
+					sf::Vector2f(u + size.x, v + size.y)));
+	vertices.append(
+			sf::Vertex(sf::Vector2f(left, top + height),
+					sf::Vector2f(u, v + size.y)));
+}
+
+}
@@ -0,0 +1,48 @@
+#ifndef CAMERAATLAS_H_
+#define CAMERAATLAS_H_
+
+// Seconds without a new frame before a feed is dropped from the layout
+#define CAM_TIMEOUT 2.0
+
+#include <SFML/Graphics.hpp>
+#include <opencv.hpp>
+
+#include "CameraIngest.h"
+
+namespace trickfire {
+
+/**
+ * Packs every camera feed into one texture, one fixed slot per camera sized
+ * for the largest frame CameraIngest will accept. New frames are uploaded into
+ * their slot in place, and all visible feeds are drawn with a single vertex
+ * array so the whole camera view costs one texture bind and one draw.
+ */
+class CameraAtlas {
+public:
+	CameraAtlas();
+
+	bool Update(int cam, const cv::Mat& rgba);
+	bool IsActive(int cam) const;
+	int GetActiveCount() const;
+
+	void Layout(const sf::FloatRect& primary, const sf::FloatRect& secondary);
+	void Draw(sf::RenderWindow& window) const;
+
+private:
+	sf::Texture texture;
+	sf::VertexArray vertices;
+	bool created;
+	unsigned int slotWidth, slotHeight;
+	unsigned int slotColumns;
+	sf::Vector2u frameSize[CAM_COUNT];
+	bool hasFrame[CAM_COUNT];
+	sf::Clock lastFrame[CAM_COUNT];
+
+	bool Create();
+	sf::Vector2u SlotOrigin(int cam) const;
+	void AppendFeed(int cam, const sf::FloatRect& area);
+};
+
+}
+
+#endif
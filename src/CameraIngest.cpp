@@ -0,0 +1,149 @@
+#include "CameraIngest.h"
+
+#include "AsyncLog.h"
+#include "Profiler.h"
+#include "AllocCounter.h"
+#include "NetworkingConstants.h"
+
+namespace trickfire {
+
+int CameraIngest::maxCols = CAM_MAX_COLS;
+int CameraIngest::maxRows = CAM_MAX_ROWS;
+// 0 means no cap beyond the maximum resolution
+std::size_t CameraIngest::memoryCap[CAM_COUNT];
+
+void CameraIngest::SetMaxResolution(int cols, int rows) {
+	maxCols = cols;
+	maxRows = rows;
+}
+
+int CameraIngest::GetMaxCols() {
+	return maxCols;
+}
+
+int CameraIngest::GetMaxRows() {
+	return maxRows;
+}
+
+void CameraIngest::SetMemoryCap(int cam, std::size_t bytes) {
+	if (cam >= 0 && cam < CAM_COUNT) {
+		memoryCap[cam] = bytes;
+	}
+}
+
+CameraIngest::Result CameraIngest::ReadPacket(PacketReader& reader,
+		cv::Mat * frames, sf::Mutex& mutex, FrameCallback frameReceived) {
+	while (!reader.AtEnd()) {
+		sf::Int32 type = -1;
+		if (!reader.ReadInt32(type)) {
+			PROFILE_COUNT("packet.truncated", 1);
+			AsyncLog::Log(AsyncLog::LEVEL_WARNING,
+					"Truncated packet header ({} bytes left)",
+					reader.Remaining());
+			return RESULT_TRUNCATED;
+		}
+
+		switch (type) {
+		case CAMERA_PACKET: {
+			PROFILE_SCOPE("packet.camera");
+			sf::Lock lock(mutex);
+			unsigned long long allocs = AllocCounter::GetThreadAllocs();
+
+			int cam = -1;
+			Result result = ReadFrame(reader, frames, cam);
+			if (result == RESULT_OK) {
+				AsyncLog::Log(AsyncLog::LEVEL_TRACE, "Camera {} frame {}x{}",
+						cam, frames[cam].cols, frames[cam].rows);
+				frameReceived(cam);
+			}
+
+			if (AllocCounter::IsEnabled()) {
+				PROFILE_COUNT("alloc.cameraIngest",
+						AllocCounter::GetThreadAllocs() - allocs);
+			}
+
+			if (result != RESULT_OK) {
+				// Can't trust anything after a bad frame, drop the rest
+				PROFILE_COUNT("packet.cameraRejected", 1);
+				AsyncLog::Log(AsyncLog::LEVEL_WARNING,
+						"Rejected camera {} frame: {}", cam,
+						ResultName(result));
+				return result;
+			}
+			break;
+		}
+		default:
+			// Unknown length, so there's no way to find the next message
+			PROFILE_COUNT("packet.unknown", 1);
+			AsyncLog::Log(AsyncLog::LEVEL_DEBUG, "Unknown packet type {}",
+					type);
+			return RESULT_UNKNOWN_TYPE;
+		}
+	}
+
+	return RESULT_OK;
+}
+
+CameraIngest::Result CameraIngest::ReadFrame(PacketReader& reader,
+		cv::Mat * frames, int& cam) {
+	sf::Int32 rows, cols;
+	if (!reader.ReadInt32(cam) || !reader.ReadInt32(rows)
+			|| !reader.ReadInt32(cols)) {
+		return RESULT_TRUNCATED;
+	}
+
+	if (cam < 0 || cam >= CAM_COUNT) {
+		return RESULT_BAD_CAMERA;
+	}
+
+	if (rows <= 0 || cols <= 0 || rows > maxRows || cols > maxCols) {
+		return RESULT_BAD_SIZE;
+	}
+
+	// Both are bounded above, so these can't overflow
+	std::size_t bytes = (std::size_t) rows * cols * 3;
+	if (memoryCap[cam] > 0
+			&& (std::size_t) rows * cols * CAM_BYTES_PER_PIXEL
+					> memoryCap[cam]) {
+		return RESULT_OVER_CAP;
+	}
+
+	// Check the length before touching the frame so a short packet doesn't
+	// leave a half written image behind
+	if (bytes > reader.Remaining()) {
+		reader.SkipToEnd();
+		return RESULT_TRUNCATED;
+	}
+
+	// No-op when the frame is the same size as the last one
+	frames[cam].create(rows, cols, CV_8UC3);
+	if (!frames[cam].isContinuous()) {
+		for (int y = 0; y < rows; y++) {
+			reader.ReadBytes(frames[cam].ptr(y), (std::size_t) cols * 3);
+		}
+	} else {
+		reader.ReadBytes(frames[cam].ptr(), bytes);
+	}
+
+	return RESULT_OK;
+}
+
+const char * CameraIngest::ResultName(Result result) {
+	switch (result) {
+	case RESULT_OK:
+		return "ok";
+	case RESULT_TRUNCATED:
+		return "truncated";
+	case RESULT_BAD_CAMERA:
+		return "bad camera index";
+	case RESULT_BAD_SIZE:
+		return "bad frame size";
+	case RESULT_OVER_CAP:
+		return "over memory cap";
+	case RESULT_UNKNOWN_TYPE:
+		return "unknown packet type";
+	}
+	return "unknown";
+}
+
+}
@@ -0,0 +1,58 @@
+#ifndef CAMERAINGEST_H_
+#define CAMERAINGEST_H_
+
+#define CAM_COUNT 5
+
+// Default limits, see CameraIngest::SetMaxResolution. Cameras have no
+// memory cap beyond that until SetMemoryCap gives them one
+#define CAM_MAX_COLS 1280
+#define CAM_MAX_ROWS 720
+
+// What the memory cap is charged per pixel: the RGB frame off the wire plus
+// the RGBA copy made for the atlas. The atlas slot itself is fixed by the
+// maximum resolution and allocated up front, so it isn't charged per frame
+#define CAM_BYTES_PER_PIXEL (3 + 4)
+
+#include <opencv.hpp>
+#include <SFML/System.hpp>
+
+#include "PacketReader.h"
+
+namespace trickfire {
+
+/**
+ * Validates camera frames received from the robot before they are copied into
+ * the per-camera frame buffers. Nothing from the wire is trusted: the camera
+ * index, the dimensions and the payload length are all checked, so a
+ * malformed packet can neither write out of bounds nor make us allocate more
+ * than the configured budget.
+ */
+class CameraIngest {
+public:
+	enum Result {
+		RESULT_OK, RESULT_TRUNCATED, RESULT_BAD_CAMERA, RESULT_BAD_SIZE,
+		RESULT_OVER_CAP, RESULT_UNKNOWN_TYPE
+	};
+
+	// Called with the frame lock held after a camera's frame is replaced
+	typedef void (*FrameCallback)(int cam);
+
+	static void SetMaxResolution(int cols, int rows);
+	static int GetMaxCols();
+	static int GetMaxRows();
+	static void SetMemoryCap(int cam, std::size_t bytes);
+
+	static Result ReadPacket(PacketReader& reader, cv::Mat * frames,
+			sf::Mutex& mutex, FrameCallback frameReceived);
+	static Result ReadFrame(PacketReader& reader, cv::Mat * frames, int& cam);
+	static const char * ResultName(Result result);
+
+private:
+	static int maxCols;
+	static int maxRows;
+	static std::size_t memoryCap[CAM_COUNT];
+};
+
+}
+
+#endif
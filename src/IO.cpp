@@ -1,39 +1,77 @@
 #include "IO.h"
 
-using namespace sf;
+#include <algorithm>
+#include <cerrno>
+
+#include "Profiler.h"
+#include "OIProtocol.h"
 
-#define BIT(val, bit) ((val & (int)pow(2, bit)) == (int)pow(2, bit))
+using namespace sf;
 
 namespace trickfire {
 
-std::array<bool, JOY_COUNT * 11> IO::prevButtonStates;
-std::array<bool, IO::prevButtonStates.size()> IO::currButtonStates;
+unsigned int IO::joyCount = JOY_DEFAULT_COUNT;
+unsigned int IO::joyButtons = JOY_DEFAULT_BUTTONS;
+std::vector<IO::JoyInfo> IO::joyInfo(JOY_DEFAULT_COUNT, IO::JoyInfo());
+std::vector<bool> IO::prevButtonStates(JOY_DEFAULT_COUNT * JOY_DEFAULT_BUTTONS);
+std::vector<bool> IO::currButtonStates(IO::prevButtonStates.size());
+bool IO::scripted;
+std::vector<sf::Uint32> IO::scriptedButtons(JOY_DEFAULT_COUNT);
 
 std::array<bool, C_REV + 1> IO::prevOIButtonStates;
 std::array<bool, IO::prevOIButtonStates.size()> IO::currOIButtonStates;
+std::array<bool, IO::prevOIButtonStates.size()> IO::latestOIButtonStates;
 sf::Mutex IO::mutex_OIvalues;
 sf::Thread IO::oiThread(&IO::ThreadLoop);
-bool IO::oiRunning;
-int IO::oiFD;
+std::atomic<bool> IO::oiRunning(false);
+int IO::oiFD = -1;
+std::string IO::oiPort;
+speed_t IO::oiSpeed;
+double IO::oiUpdateRate;
+unsigned long long IO::oiErrors;
+unsigned long long IO::oiLost;
+sf::Int64 IO::oiChangeTime;
+sf::Int64 IO::latchedOIChangeTime;
+
+void IO::StartOI(const std::string& port, int baud) {
+	speed_t speed;
+	if (!BaudToSpeed(baud, speed)) {
+		AsyncLog::Log(AsyncLog::LEVEL_ERROR, "Unsupported OI baud {}", baud);
+		return;
+	}
 
-void IO::StartOI() {
-	oiFD = open("/dev/ttyACM0", O_RDWR);
+	oiPort = port;
+	oiSpeed = speed;
+	oiFD = OpenOI(AsyncLog::LEVEL_ERROR);
+	if (oiFD != -1) {
+		AsyncLog::Log(AsyncLog::LEVEL_INFO, "OI started at {} baud", baud);
+	}
 
-	if (oiFD == -1) {
-		Logger::Log(Logger::LEVEL_ERROR_CRITICAL, "Failed to open OI port");
-		return;
+	// Started even if the port isn't there yet, it keeps trying to open it
+	oiRunning = true;
+	oiThread.launch();
+}
+
+int IO::OpenOI(AsyncLog::Level errorLevel) {
+	int fd = open(oiPort.c_str(), O_RDWR | O_NOCTTY);
+
+	if (fd == -1) {
+		AsyncLog::Log(errorLevel, "Failed to open OI port (errno {})", errno);
+		return -1;
 	}
 
-	if (!isatty(oiFD)) {
-		Logger::Log(Logger::LEVEL_ERROR_CRITICAL, "OI port not TTY");
-		return;
+	if (!isatty(fd)) {
+		AsyncLog::Log(errorLevel, "OI port not TTY");
+		close(fd);
+		return -1;
 	}
 
 	struct termios tio;
-	if (tcgetattr(oiFD, &tio) < 0) {
-		Logger::Log(Logger::LEVEL_ERROR_CRITICAL,
-				"Error getting OI attributes");
-		return;
+	if (tcgetattr(fd, &tio) < 0) {
+		AsyncLog::Log(errorLevel, "Error getting OI attributes (errno {})",
+				errno);
+		close(fd);
+		return -1;
 	}
 
 	tio.c_iflag = 0;
@@ -43,75 +81,186 @@ void IO::StartOI() {
 	tio.c_cc[VMIN] = 1;
 	tio.c_cc[VTIME] = 5;
 
-	if (cfsetispeed(&tio, B9600) < 0 || cfsetospeed(&tio, B9600) < 0) {
-		Logger::Log(Logger::LEVEL_ERROR_CRITICAL, "Error setting OI baud");
-		return;
+	if (cfsetispeed(&tio, oiSpeed) < 0 || cfsetospeed(&tio, oiSpeed) < 0) {
+		AsyncLog::Log(errorLevel, "Error setting OI baud (errno {})", errno);
+		close(fd);
+		return -1;
 	}
 
-	if (tcsetattr(oiFD, TCSAFLUSH, &tio) < 0) {
-		Logger::Log(Logger::LEVEL_ERROR_CRITICAL,
-				"Error setting OI attributes");
-		return;
+	if (tcsetattr(fd, TCSAFLUSH, &tio) < 0) {
+		AsyncLog::Log(errorLevel, "Error setting OI attributes (errno {})",
+				errno);
+		close(fd);
+		return -1;
 	}
 
-	oiRunning = true;
-	oiThread.launch();
+	return fd;
+}
+
+bool IO::BaudToSpeed(int baud, speed_t& speed) {
+	switch (baud) {
+	case 9600:
+		speed = B9600;
+		return true;
+	case 19200:
+		speed = B19200;
+		return true;
+	case 38400:
+		speed = B38400;
+		return true;
+	case 57600:
+		speed = B57600;
+		return true;
+	case 115200:
+		speed = B115200;
+		return true;
+	case 230400:
+		speed = B230400;
+		return true;
+#ifdef B460800
+	case 460800:
+		speed = B460800;
+		return true;
+#endif
+#ifdef B921600
+	case 921600:
+		speed = B921600;
+		return true;
+#endif
+	default:
+		return false;
+	}
 }
 
 void IO::StopOI() {
+	// The OI thread wakes up at least every OI_POLL_MS to notice this
 	oiRunning = false;
+	oiThread.wait();
+
+	if (oiFD != -1) {
+		close(oiFD);
+		oiFD = -1;
+	}
 }
 
 void IO::ThreadLoop() {
-	int index = 0;
-	int max = 4;
-	char values[max];
-	for (int i = 0; i < 4; i++) {
-		values[i] = 0;
-	}
+	OIParser parser;
+	unsigned char buffer[64];
+
+	Clock rateClock;
+	unsigned long long rateFrames = 0;
 
 	while (oiRunning) {
-		unsigned char val = 0;
-		if (read(oiFD, &val, 1) > 0) {
-			if (val == 255) {
-				// This is the divider
-				index = 0;
+		int count = 0;
+		if (oiFD == -1) {
+			// Unplugged, try again every OI_POLL_MS until it's back
+			sf::sleep(sf::milliseconds(OI_POLL_MS));
+			oiFD = OpenOI(AsyncLog::LEVEL_DEBUG);
+			if (oiFD != -1) {
+				AsyncLog::Log(AsyncLog::LEVEL_INFO, "OI link reopened");
+				parser.Resync();
+			}
+		} else {
+			// Don't block in read, a silent OI still has to bring the rate
+			// down to 0 and let StopOI end the thread
+			struct pollfd pfd;
+			pfd.fd = oiFD;
+			pfd.events = POLLIN;
+			bool failed = false;
+			if (poll(&pfd, 1, OI_POLL_MS) > 0) {
+				// A hung up tty also reports POLLIN and reads 0 forever, so
+				// check for that first
+				if (pfd.revents & (POLLHUP | POLLERR | POLLNVAL)) {
+					failed = true;
+				} else if (pfd.revents & POLLIN) {
+					count = read(oiFD, buffer, sizeof(buffer));
+					if (count < 0 && errno == EINTR) {
+						count = 0;
+					} else if (count <= 0) {
+						failed = true;
+					}
+				}
+			}
+
+			if (failed) {
+				AsyncLog::Log(AsyncLog::LEVEL_WARNING,
+						"OI link lost, reopening");
+				close(oiFD);
+				oiFD = -1;
+				count = 0;
+
+				// Don't leave whatever was held down pressed while it's gone
+				sf::Lock oiLock(mutex_OIvalues);
+				latestOIButtonStates.fill(false);
+			}
+		}
+
+		for (int b = 0; b < count; b++) {
+			OIParser::Result result = parser.Push(buffer[b]);
+			if (result == OIParser::RESULT_FRAME) {
+				PROFILE_SCOPE("oi.parse");
+				const Uint8 * payload = parser.GetPayload();
+				unsigned int bits = parser.GetPayloadSize() * 8;
 
 				mutex_OIvalues.lock();
 
-				// Update state array
-				for (unsigned int i = 0; i < prevOIButtonStates.size(); i++) {
-					prevOIButtonStates[i] = currOIButtonStates[i];
+				// Update state array, anything the frame doesn't cover is off
+				bool changed = false;
+				for (unsigned int i = 0; i < latestOIButtonStates.size(); i++) {
+					bool state = i < bits && ((payload[i / 8] >> (i % 8)) & 1);
+					changed = changed || state != latestOIButtonStates[i];
+					latestOIButtonStates[i] = state;
 				}
-				for (unsigned int i = 0; i < currOIButtonStates.size(); i++) {
-					currOIButtonStates[i] = BIT(values[(int )floor(i / 8)],
-							i % 8);
+
+				// Remember when the first unseen change arrived for latency
+				if (changed && oiChangeTime == 0) {
+					oiChangeTime = Profiler::Now();
 				}
 
 				mutex_OIvalues.unlock();
-			} else {
-				values[index] = val;
-				index++;
-				if (index >= max)
-					index = max - 1;
+			} else if (result != OIParser::RESULT_NONE) {
+				PROFILE_COUNT("oi.badFrame", 1);
 			}
+		}
 
-			/*for (unsigned int i = 0; i < currOIButtonStates.size(); i++) {
-				std::cout << currOIButtonStates[i];
-			}
-
-			std::cout << std::endl;*/
-
+		if (rateClock.getElapsedTime().asSeconds() >= 1.0) {
+			sf::Lock oiLock(mutex_OIvalues);
+			oiUpdateRate = (parser.GetFrameCount() - rateFrames)
+					/ rateClock.restart().asSeconds();
+			rateFrames = parser.GetFrameCount();
+			oiErrors = parser.GetErrorCount();
+			oiLost = parser.GetLostCount();
 		}
 	}
 }
 
+double IO::GetOIUpdateRate() {
+	sf::Lock oiLock(mutex_OIvalues);
+	return oiUpdateRate;
+}
+
+unsigned long long IO::GetOIErrorCount() {
+	sf::Lock oiLock(mutex_OIvalues);
+	return oiErrors;
+}
+
+unsigned long long IO::GetOILostCount() {
+	sf::Lock oiLock(mutex_OIvalues);
+	return oiLost;
+}
+
+sf::Int64 IO::TakeOIChangeTime() {
+	sf::Int64 time = latchedOIChangeTime;
+	latchedOIChangeTime = 0;
+	return time;
+}
+
 double IO::JoyX(unsigned int stick) {
 	if (IsJoyConnected(stick)) {
-		return Joystick::getAxisPosition(stick, Joystick::X) / 100;
+		return joyInfo[stick].x;
 	}
 #if defined(JOY_SUB) and JOY_SUB == 1
-	else {
+	else if (!scripted) {
 		if (Keyboard::isKeyPressed(Keyboard::A)) {
 			return -1.0;
 		} else if (Keyboard::isKeyPressed(Keyboard::D)) {
@@ -120,16 +269,16 @@ double IO::JoyX(unsigned int stick) {
 			return 0.0;
 		}
 	}
-	return 0.0;
 #endif
+	return 0.0;
 }
 
 double IO::JoyY(unsigned int stick) {
 	if (IsJoyConnected(stick)) {
-		return -Joystick::getAxisPosition(stick, Joystick::Y) / 100;
+		return joyInfo[stick].y;
 	}
 #if defined(JOY_SUB) and JOY_SUB == 1
-	else {
+	else if (!scripted) {
 		if (Keyboard::isKeyPressed(Keyboard::S)) {
 			return -1.0;
 		} else if (Keyboard::isKeyPressed(Keyboard::W)) {
@@ -138,53 +287,195 @@ double IO::JoyY(unsigned int stick) {
 			return 0.0;
 		}
 	}
-	return 0.0;
 #endif
+	return 0.0;
 }
 
 bool IO::JoyButton(unsigned int stick, unsigned int button) {
-	return currButtonStates[stick * 11 + button];
+	if (stick >= joyCount || button >= joyButtons)
+		return false;
+	return currButtonStates[stick * joyButtons + button];
 }
 
 bool IO::JoyButtonTrig(unsigned int stick, unsigned int button) {
-	return currButtonStates[stick * 11 + button]
-			&& !prevButtonStates[stick * 11 + button];
+	if (stick >= joyCount || button >= joyButtons)
+		return false;
+	return currButtonStates[stick * joyButtons + button]
+			&& !prevButtonStates[stick * joyButtons + button];
 }
 
 bool IO::JoyButtonUntrig(unsigned int stick, unsigned int button) {
-	return !currButtonStates[stick * 11 + button]
-			&& prevButtonStates[stick * 11 + button];
+	if (stick >= joyCount || button >= joyButtons)
+		return false;
+	return !currButtonStates[stick * joyButtons + button]
+			&& prevButtonStates[stick * joyButtons + button];
 }
 
 bool IO::IsJoyConnected(unsigned int stick) {
-	return Joystick::isConnected(stick);
+	return stick < joyCount && joyInfo[stick].connected;
 }
 
-bool IO::OIButton(unsigned int button) {
+void IO::SetJoyConfig(unsigned int count, unsigned int buttons) {
+	// SFML can't track more than this, so don't pretend we can
+	joyCount = std::min(count, (unsigned int) Joystick::Count);
+	joyButtons = std::min(buttons, (unsigned int) Joystick::ButtonCount);
+
+	joyInfo.assign(joyCount, JoyInfo());
+	prevButtonStates.assign(joyCount * joyButtons, false);
+	currButtonStates.assign(prevButtonStates.size(), false);
+	scriptedButtons.assign(joyCount, 0);
+
+	ScanJoysticks();
+}
+
+void IO::ScanJoysticks() {
+	if (scripted) {
+		return;
+	}
+
+	// SFML only raises connect events for devices plugged in after the
+	// window was created, so anything already present has to be found here
+	Joystick::update();
+	for (unsigned int i = 0; i < joyCount; i++) {
+		RefreshJoyInfo(i);
+	}
+}
+
+void IO::HandleJoyEvent(const Event& event) {
+	if (scripted) {
+		return;
+	}
+
+	if (event.type == Event::JoystickConnected
+			|| event.type == Event::JoystickDisconnected) {
+		unsigned int stick = event.joystickConnect.joystickId;
+		if (stick < joyCount) {
+			RefreshJoyInfo(stick);
+			AsyncLog::Log(AsyncLog::LEVEL_INFO,
+					"Joystick {} {} ({} buttons)", stick,
+					joyInfo[stick].connected ? "connected" : "disconnected",
+					joyInfo[stick].buttonCount);
+		}
+	}
+}
+
+void IO::SetScriptedInput(bool scripted) {
+	IO::scripted = scripted;
+
+	// Scripted sticks only exist once the script mentions them
+	for (unsigned int i = 0; i < joyCount; i++) {
+		joyInfo[i] = JoyInfo();
+		scriptedButtons[i] = 0;
+	}
+	prevButtonStates.assign(prevButtonStates.size(), false);
+	currButtonStates.assign(currButtonStates.size(), false);
+
+	if (!scripted) {
+		ScanJoysticks();
+	}
+}
+
+void IO::InjectJoy(unsigned int stick, double x, double y,
+		sf::Uint32 buttons) {
+	if (!scripted || stick >= joyCount) {
+		return;
+	}
+
+	JoyInfo& info = joyInfo[stick];
+	info.connected = true;
+	info.buttonCount = std::min(joyButtons, 32u);
+	info.hasX = info.hasY = true;
+	info.x = x;
+	info.y = y;
+	scriptedButtons[stick] = buttons;
+}
+
+void IO::InjectOI(sf::Uint32 buttons) {
 	sf::Lock oiLock(mutex_OIvalues);
+
+	bool changed = false;
+	for (unsigned int i = 0; i < latestOIButtonStates.size(); i++) {
+		bool state = (buttons >> i) & 1;
+		changed = changed || state != latestOIButtonStates[i];
+		latestOIButtonStates[i] = state;
+	}
+
+	if (changed && oiChangeTime == 0) {
+		oiChangeTime = Profiler::Now();
+	}
+}
+
+void IO::RefreshJoyInfo(unsigned int stick) {
+	JoyInfo& info = joyInfo[stick];
+	info.connected = Joystick::isConnected(stick);
+	info.buttonCount =
+			info.connected ?
+					std::min(Joystick::getButtonCount(stick), joyButtons) : 0;
+	info.hasX = info.connected && Joystick::hasAxis(stick, Joystick::X);
+	info.hasY = info.connected && Joystick::hasAxis(stick, Joystick::Y);
+	info.x = 0.0;
+	info.y = 0.0;
+
+	// Don't leave stale presses behind from an unplugged device
+	for (unsigned int b = 0; b < joyButtons; b++) {
+		prevButtonStates[stick * joyButtons + b] = false;
+		currButtonStates[stick * joyButtons + b] = false;
+	}
+}
+
+bool IO::OIButton(unsigned int button) {
 	return currOIButtonStates[button];
 }
 
 bool IO::OIButtonTrig(unsigned int button) {
-	sf::Lock oiLock(mutex_OIvalues);
 	return !prevOIButtonStates[button] && currOIButtonStates[button];
 
 }
 
 bool IO::OIButtonUntrig(unsigned int button) {
-	sf::Lock oiLock(mutex_OIvalues);
 	return prevOIButtonStates[button] && !currOIButtonStates[button];
 
 }
 
 void IO::UpdateButtonStates() {
-	for (unsigned int i = 0; i < prevButtonStates.size(); i++) {
-		prevButtonStates[i] = currButtonStates[i];
+	// Latch the OI state once per tick so an edge is seen by the whole tick,
+	// no matter how many frames the OI sent in between
+	mutex_OIvalues.lock();
+	prevOIButtonStates = currOIButtonStates;
+	currOIButtonStates = latestOIButtonStates;
+	if (oiChangeTime != 0) {
+		latchedOIChangeTime = oiChangeTime;
+		oiChangeTime = 0;
 	}
-	for (unsigned int i = 0; i < currButtonStates.size(); i++) {
-		unsigned int stick = i / 11;
-		unsigned int button = i % 11;
-		currButtonStates[i] = Joystick::isButtonPressed(stick, button);
+	mutex_OIvalues.unlock();
+
+	prevButtonStates.swap(currButtonStates);
+
+	for (unsigned int stick = 0; stick < joyCount; stick++) {
+		JoyInfo& info = joyInfo[stick];
+		if (!info.connected)
+			continue;
+
+		if (scripted) {
+			// Axes were already set by InjectJoy
+			for (unsigned int button = 0; button < info.buttonCount;
+					button++) {
+				currButtonStates[stick * joyButtons + button] =
+						(scriptedButtons[stick] >> button) & 1;
+			}
+			continue;
+		}
+
+		// Sample everything once here so the rest of the tick reads the cache
+		if (info.hasX)
+			info.x = Joystick::getAxisPosition(stick, Joystick::X) / 100;
+		if (info.hasY)
+			info.y = -Joystick::getAxisPosition(stick, Joystick::Y) / 100;
+
+		for (unsigned int button = 0; button < info.buttonCount; button++) {
+			currButtonStates[stick * joyButtons + button] =
+					Joystick::isButtonPressed(stick, button);
+		}
 	}
 }
 }
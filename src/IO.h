@@ -2,17 +2,26 @@
 #define IO_H_
 
 #define JOY_SUB 1
-#define JOY_COUNT 2
+#define JOY_DEFAULT_COUNT 2
+#define JOY_DEFAULT_BUTTONS 11
+
+#define OI_DEFAULT_PORT "/dev/ttyACM0"
+#define OI_DEFAULT_BAUD 115200
+#define OI_POLL_MS 100
 
 #include <array>
+#include <atomic>
+#include <string>
+#include <vector>
 #include <cmath>
 #include <math.h>
 #include <fcntl.h>
+#include <poll.h>
 #include <unistd.h>
 #include <termios.h>
 #include <SFML/System.hpp>
 #include <SFML/Window.hpp>
-#include <Logger.h>
+#include "AsyncLog.h"
 
 // ANALOGS
 #define L_STAGE2SPEED 0
@@ -62,28 +71,72 @@ public:
 	static bool JoyButtonUntrig(unsigned int stick, unsigned int button);
 	static bool IsJoyConnected(unsigned int stick);
 
+	static void SetJoyConfig(unsigned int count, unsigned int buttons);
+	static void ScanJoysticks();
+	static void HandleJoyEvent(const sf::Event& event);
+
+	static void SetScriptedInput(bool scripted);
+	static void InjectJoy(unsigned int stick, double x, double y,
+			sf::Uint32 buttons);
+	static void InjectOI(sf::Uint32 buttons);
+
 	static bool OIButton(unsigned int button);
 	static bool OIButtonTrig(unsigned int stick);
 	static bool OIButtonUntrig(unsigned int stick);
 
 	static void UpdateButtonStates();
 
-	static void StartOI();
+	static void StartOI(const std::string& port = OI_DEFAULT_PORT, int baud =
+			OI_DEFAULT_BAUD);
 	static void StopOI();
+	static double GetOIUpdateRate();
+	static unsigned long long GetOIErrorCount();
+	static unsigned long long GetOILostCount();
+	static sf::Int64 TakeOIChangeTime();
 
 private:
-	static std::array<bool, JOY_COUNT * 11> prevButtonStates;
-	static std::array<bool, prevButtonStates.size()> currButtonStates;
-
+	// Cached capabilities and per-tick state of a single joystick
+	struct JoyInfo {
+		bool connected;
+		unsigned int buttonCount;
+		bool hasX, hasY;
+		double x, y;
+	};
+
+	static unsigned int joyCount;
+	static unsigned int joyButtons;
+	static std::vector<JoyInfo> joyInfo;
+	static std::vector<bool> prevButtonStates;
+	static std::vector<bool> currButtonStates;
+
+	// Scripted input replaces the real joysticks and keyboard substitution
+	static bool scripted;
+	static std::vector<sf::Uint32> scriptedButtons;
+
+	// prev/curr are latched from latest once per tick by UpdateButtonStates,
+	// so only latest is shared with the OI thread
 	static std::array<bool, C_REV + 1> prevOIButtonStates;
 	static std::array<bool, prevOIButtonStates.size()> currOIButtonStates;
+	static std::array<bool, prevOIButtonStates.size()> latestOIButtonStates;
 
 	static int oiFD;
+	static std::string oiPort;
+	static speed_t oiSpeed;
 	static sf::Mutex mutex_OIvalues;
 	static sf::Thread oiThread;
-	static bool oiRunning;
+	static std::atomic<bool> oiRunning;
+
+	// OI link statistics, guarded by mutex_OIvalues
+	static double oiUpdateRate;
+	static unsigned long long oiErrors;
+	static unsigned long long oiLost;
+	static sf::Int64 oiChangeTime;
+	static sf::Int64 latchedOIChangeTime;
 
 	static void ThreadLoop();
+	static int OpenOI(AsyncLog::Level errorLevel);
+	static bool BaudToSpeed(int baud, speed_t& speed);
+	static void RefreshJoyInfo(unsigned int stick);
 };
 
 }
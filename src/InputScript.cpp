@@ -0,0 +1,123 @@
+#include "InputScript.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+
+#include "AsyncLog.h"
+#include "IO.h"
+
+namespace trickfire {
+
+InputScript::InputScript() :
+		next(0), looping(false), loopStart(0) {
+}
+
+bool InputScript::Load(const std::string& file) {
+	std::ifstream in(file.c_str());
+	if (!in.is_open()) {
+		AsyncLog::Log(AsyncLog::LEVEL_ERROR, "Failed to open input script");
+		return false;
+	}
+
+	events.clear();
+	next = 0;
+	loopStart = 0;
+
+	std::string line;
+	unsigned int lineNumber = 0;
+	while (std::getline(in, line)) {
+		lineNumber++;
+		std::istringstream fields(line);
+
+		Event event;
+		std::string source, buttons;
+		if (!(fields >> event.time)) {
+			// Blank or comment lines have no timestamp, anything else is bad
+			std::string first;
+			std::istringstream check(line);
+			if (!(check >> first) || first[0] == '#') {
+				continue;
+			}
+			AsyncLog::Log(AsyncLog::LEVEL_ERROR,
+					"Input script line {}: missing timestamp", lineNumber);
+			return false;
+		}
+
+		bool ok = (bool) (fields >> source);
+		if (ok && source == "joy") {
+			event.oi = false;
+			ok = (bool) (fields >> event.stick >> event.x >> event.y >> buttons);
+		} else if (ok && source == "oi") {
+			event.oi = true;
+			event.stick = 0;
+			event.x = event.y = 0.0;
+			ok = (bool) (fields >> buttons);
+		} else {
+			ok = false;
+		}
+
+		if (!ok) {
+			AsyncLog::Log(AsyncLog::LEVEL_ERROR, "Input script line {}: bad event",
+					lineNumber);
+			return false;
+		}
+
+		event.buttons = strtoul(buttons.c_str(), NULL, 0);
+		events.push_back(event);
+	}
+
+	std::stable_sort(events.begin(), events.end(), EventBefore);
+	return true;
+}
+
+bool InputScript::Update(sf::Int64 elapsedMs) {
+	bool applied = false;
+
+	while (next < events.size() && events[next].time <= elapsedMs - loopStart) {
+		Apply(events[next]);
+		next++;
+		applied = true;
+	}
+
+	if (looping && !events.empty() && next >= events.size()) {
+		// Start over once the last event's time has passed, skipping whole
+		// passes we slept through rather than replaying them. The new pass is
+		// applied from the next tick on, so the last event of this one is
+		// never overwritten before anyone reads it.
+		sf::Int64 period = std::max(events.back().time, (sf::Int64) 1);
+		if (elapsedMs - loopStart >= period) {
+			loopStart += ((elapsedMs - loopStart) / period) * period;
+			next = 0;
+		}
+	}
+
+	return applied;
+}
+
+void InputScript::SetLooping(bool loop) {
+	looping = loop;
+}
+
+bool InputScript::IsFinished() const {
+	return !looping && next >= events.size();
+}
+
+unsigned int InputScript::GetEventCount() const {
+	return events.size();
+}
+
+bool InputScript::EventBefore(const Event& a, const Event& b) {
+	return a.time < b.time;
+}
+
+void InputScript::Apply(const Event& event) {
+	if (event.oi) {
+		IO::InjectOI(event.buttons);
+	} else {
+		IO::InjectJoy(event.stick, event.x, event.y, event.buttons);
+	}
+}
+
+}
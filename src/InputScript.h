@@ -0,0 +1,52 @@
+#ifndef INPUTSCRIPT_H_
+#define INPUTSCRIPT_H_
+
+#include <string>
+#include <vector>
+#include <SFML/System.hpp>
+
+namespace trickfire {
+
+/**
+ * Plays back timestamped joystick and OI values from a file in place of the
+ * real devices, for running the driver station unattended. Each line is one
+ * of
+ *
+ *   <ms> joy <stick> <x> <y> <buttons>
+ *   <ms> oi <buttons>
+ *
+ * where buttons is a bit mask (decimal or 0x hex) with button 0 in the lowest
+ * bit. Blank lines and lines starting with # are ignored.
+ */
+class InputScript {
+public:
+	InputScript();
+
+	bool Load(const std::string& file);
+	bool Update(sf::Int64 elapsedMs);
+
+	void SetLooping(bool loop);
+	bool IsFinished() const;
+	unsigned int GetEventCount() const;
+
+private:
+	struct Event {
+		sf::Int64 time;
+		bool oi;
+		unsigned int stick;
+		double x, y;
+		sf::Uint32 buttons;
+	};
+
+	std::vector<Event> events;
+	unsigned int next;
+	bool looping;
+	sf::Int64 loopStart;
+
+	static bool EventBefore(const Event& a, const Event& b);
+	void Apply(const Event& event);
+};
+
+}
+
+#endif
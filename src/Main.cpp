@@ -1,13 +1,27 @@
 #include <iostream>
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
 #include <SFML/Network.hpp>
 #include <SFML/Window.hpp>
 #include <SFML/Graphics.hpp>
 #include <pthread.h>
+#include <csignal>
+#include <sys/resource.h>
+#include <arpa/inet.h>
 
 #include <opencv.hpp>
 
 #include "Server.h"
 #include "Logger.h"
+#include "AsyncLog.h"
+#include "Profiler.h"
+#include "PacketPool.h"
+#include "AllocCounter.h"
+#include "PacketReader.h"
+#include "CameraIngest.h"
+#include "CameraAtlas.h"
+#include "InputScript.h"
 #include "DrawingUtil.h"
 #include "IO.h"
 #include "NetworkingConstants.h"
@@ -24,9 +38,8 @@
 #define ROW1 8
 #define ROW2 64
 #define ROW3 128
-#define ROW4 ROW3+264+16
+#define ROW4 (ROW3 + 264 + 16)
 
-#define CAM_COUNT 5
 
 using namespace std;
 using namespace trickfire;
@@ -42,6 +55,30 @@ bool prevNum1, currNum1;
 // (to fix physical camera rotation)
 bool img0Flip, img1Flip;
 
+// Whether the profiler panel is shown (toggled with F3)
+bool showProfiler;
+
+// When the OI input behind this tick's commands arrived, 0 once reported
+sf::Int64 pendingOIChange;
+
+// Scripted input, used in place of the joysticks and OI when loaded
+InputScript inputScript;
+bool useInputScript;
+sf::Clock inputScriptClock;
+sf::Int64 pendingScriptInput;
+
+// Headless mode, run until the duration (in seconds, 0 for no limit) passes,
+// the script ends or we're interrupted
+volatile sig_atomic_t headlessRunning = 1;
+double headlessDuration;
+unsigned int headlessRate = 60;
+
+// Command traffic totals, only touched by the thread sending commands
+unsigned long long commandsSent, commandBytesSent;
+
+// Allocations made inside Server::Send this tick, kept out of alloc.commands
+unsigned long long sendAllocs;
+
 // Whether or not we should transmit camera images
 sf::Mutex mut_Transmit;
 bool transmit = true;
@@ -49,24 +86,78 @@ bool transmit = true;
 // Camera feed components
 sf::Mutex mutex_cameraVars;
 cv::Mat frameRGB[CAM_COUNT], frameRGBA[CAM_COUNT];
-sf::Image image[CAM_COUNT];
-sf::Texture texture[CAM_COUNT];
-sf::Sprite sprite[CAM_COUNT];
+bool frameDirty[CAM_COUNT];
+CameraAtlas cameraAtlas;
+
+// Reused buffers for outgoing commands, none are kept past a single send
+PacketPool commandPool(4, 64);
 
 /**
- * Updates the camera feed variables for display to the window
- *
- * @param cam The camera feed index to update
+ * Converts the received camera frames to RGBA, one camera per worker
  */
-void UpdateCameraFeedGraphics(int cam) {
-	if (!frameRGB[cam].empty()) {
-		cv::cvtColor(frameRGB[cam], frameRGBA[cam], cv::COLOR_BGR2RGBA);
-		image[cam].create(frameRGBA[cam].cols, frameRGBA[cam].rows,
-				frameRGBA[cam].ptr());
-		if (texture[cam].loadFromImage(image[cam])) {
-			sprite[cam].setTexture(texture[cam]);
+class ConvertCameraFeeds: public cv::ParallelLoopBody {
+public:
+	ConvertCameraFeeds(const int * cams) :
+			cams(cams) {
+	}
+
+	virtual void operator()(const cv::Range& range) const {
+		for (int i = range.start; i < range.end; i++) {
+			// frameRGBA is already the right size, so this never allocates
+			cv::cvtColor(frameRGB[cams[i]], frameRGBA[cams[i]],
+					cv::COLOR_BGR2RGBA);
 		}
 	}
+
+private:
+	const int * cams;
+};
+
+/**
+ * Updates the camera atlas with any camera frames received since the last call
+ */
+void UpdateCameraFeedGraphics() {
+	int dirty[CAM_COUNT];
+	int dirtyCount = 0;
+	for (int cam = 0; cam < CAM_COUNT; cam++) {
+		if (frameDirty[cam] && !frameRGB[cam].empty()) {
+			dirty[dirtyCount++] = cam;
+		}
+		frameDirty[cam] = false;
+	}
+
+	if (dirtyCount == 0) {
+		return;
+	}
+
+	// Resize on this thread rather than in the workers, so the allocation
+	// counter (which is per thread) sees it. No-op if the size didn't change
+	for (int i = 0; i < dirtyCount; i++) {
+		frameRGBA[dirty[i]].create(frameRGB[dirty[i]].rows,
+				frameRGB[dirty[i]].cols, CV_8UC4);
+	}
+
+	{
+		PROFILE_SCOPE("camera.cvtColor");
+		cv::parallel_for_(cv::Range(0, dirtyCount),
+				ConvertCameraFeeds(dirty));
+	}
+
+	PROFILE_SCOPE("camera.textureUpload");
+	for (int i = 0; i < dirtyCount; i++) {
+		cameraAtlas.Update(dirty[i], frameRGBA[dirty[i]]);
+	}
+}
+
+/**
+ * Called with the camera lock held whenever a camera frame is received
+ *
+ * @param cam The camera whose frame was replaced
+ */
+void CameraFrameReceived(int cam) {
+	if ((cam == 0 && img0Flip) || (cam == 1 && img1Flip))
+		cv::flip(frameRGB[cam], frameRGB[cam], -1);
+	frameDirty[cam] = true;
 }
 
 /**
@@ -75,37 +166,56 @@ void UpdateCameraFeedGraphics(int cam) {
  * @param packet The packet received
  */
 void PacketReceived(Packet& packet) {
-	while (!packet.endOfPacket()) {
-		int type = -1;
-		packet >> type;
-
-		switch (type) {
-		case CAMERA_PACKET: {
-			// Output the received camera data to our local varables
-			int cam;
-			int rows, cols;
-			packet >> cam >> rows >> cols;
-			mutex_cameraVars.lock();
-			frameRGB[cam] = cv::Mat(rows, cols, 16);
-			uint8_t* newdata = (uint8_t*) frameRGB[cam].data;
-
-			for (int y = 0; y < frameRGB[0].rows; y++) {
-				for (int x = 0; x < frameRGB[0].cols; x++) {
-					packet >> newdata[y * frameRGB[cam].cols * 3 + x * 3 + 0];
-					packet >> newdata[y * frameRGB[cam].cols * 3 + x * 3 + 1];
-					packet >> newdata[y * frameRGB[cam].cols * 3 + x * 3 + 2];
-				}
-			}
-			if ((cam == 0 && img0Flip) || (cam == 1 && img1Flip))
-				cv::flip(frameRGB[cam], frameRGB[cam], -1);
+	PacketReader reader(packet.getData(), packet.getDataSize());
+	CameraIngest::ReadPacket(reader, frameRGB, mutex_cameraVars,
+			CameraFrameReceived);
+}
 
-			mutex_cameraVars.unlock();
-			break;
-		}
-		default:
-			break;
-		}
+/**
+ * Sends a command packet to the robot, tracing it if packet logging is enabled
+ *
+ * @param server The server to send through
+ * @param packet The command packet, starting with its packet type
+ */
+void SendCommand(Server * server, Packet& packet) {
+	if (AsyncLog::IsEnabled(AsyncLog::LEVEL_TRACE)
+			&& packet.getDataSize() >= sizeof(sf::Int32)) {
+		sf::Int32 type;
+		memcpy(&type, packet.getData(), sizeof(type));
+		AsyncLog::Log(AsyncLog::LEVEL_TRACE, "Sent command {} ({} bytes)",
+				(sf::Int32) ntohl(type), packet.getDataSize());
+	}
+
+	if (pendingScriptInput != 0) {
+		PROFILE_SAMPLE("script.inputToPacket",
+				Profiler::Now() - pendingScriptInput);
+		pendingScriptInput = 0;
+	}
+
+	commandsSent++;
+	commandBytesSent += packet.getDataSize();
+
+	PROFILE_COUNT("net.sendBytes", packet.getDataSize());
+	PROFILE_SCOPE("net.send");
+	unsigned long long allocs = AllocCounter::GetThreadAllocs();
+	server->Send(packet);
+	sendAllocs += AllocCounter::GetThreadAllocs() - allocs;
+}
+
+/**
+ * Sends a command packet driven by the OI, timing it against the OI input
+ * that caused it
+ *
+ * @param server The server to send through
+ * @param packet The command packet, starting with its packet type
+ */
+void SendOICommand(Server * server, Packet& packet) {
+	if (pendingOIChange != 0) {
+		PROFILE_SAMPLE("oi.inputToPacket", Profiler::Now() - pendingOIChange);
+		pendingOIChange = 0;
 	}
+
+	SendCommand(server, packet);
 }
 
 /**
@@ -126,6 +236,46 @@ void DrawTrickFireHeader(Font& font, RenderWindow& window) {
 	window.draw(header);
 }
 
+/**
+ * Draws the profiler summaries on top of the rest of the GUI
+ *
+ * @param font The font to draw text in
+ * @param window The window to draw to
+ */
+void DrawProfilerPanel(Font& font, RenderWindow& window) {
+	std::vector<Profiler::Summary> summaries;
+	Profiler::Snapshot(summaries);
+
+	RectangleShape background(Vector2f(560, 16 + summaries.size() * 16));
+	background.setFillColor(Color(0, 0, 0, 200));
+	background.setPosition(COL1, ROW2);
+	window.draw(background);
+
+	Text line;
+	line.setFont(font);
+	line.setCharacterSize(14);
+	line.setColor(Color::Green);
+	for (unsigned int i = 0; i < summaries.size(); i++) {
+		const Profiler::Summary& s = summaries[i];
+		char buffer[128];
+		if (s.timer) {
+			snprintf(buffer, sizeof(buffer),
+					"%-24s n=%-8llu avg=%-6llu p99<=%-6llu max=%llu us",
+					s.name.c_str(), (unsigned long long) s.count,
+					(unsigned long long) (s.count ? s.total / s.count : 0),
+					(unsigned long long) s.p99, (unsigned long long) s.max);
+		} else {
+			snprintf(buffer, sizeof(buffer),
+					"%-24s n=%-8llu total=%-10llu max=%llu", s.name.c_str(),
+					(unsigned long long) s.count, (unsigned long long) s.total,
+					(unsigned long long) s.max);
+		}
+		line.setString(buffer);
+		line.setPosition(COL1 + 8, ROW2 + 8 + i * 16);
+		window.draw(line);
+	}
+}
+
 /**
  * Updates the GUI of the window with all of the necessary information
  *
@@ -134,6 +284,7 @@ void DrawTrickFireHeader(Font& font, RenderWindow& window) {
  * @param winow The window to draw to
  */
 void UpdateGUI(Font& font, Server * server, RenderWindow& window) {
+	PROFILE_SCOPE("gui.update");
 	window.clear(Color::Black);
 
 	DrawTrickFireHeader(font, window);
@@ -149,6 +300,19 @@ void UpdateGUI(Font& font, Server * server, RenderWindow& window) {
 				false, font, Color::Red, window);
 	}
 
+	// Draw the OI link statistics
+	char oiStatus[64];
+	snprintf(oiStatus, sizeof(oiStatus), "OI %.0f Hz  %llu err  %llu lost",
+			IO::GetOIUpdateRate(), IO::GetOIErrorCount(),
+			IO::GetOILostCount());
+	Text oiText;
+	oiText.setFont(font);
+	oiText.setCharacterSize(16);
+	oiText.setColor(Color::Green);
+	oiText.setString(oiStatus);
+	oiText.setPosition(COL3, ROW1 + 16);
+	window.draw(oiText);
+
 	// Draw the joystick input values
 	Vector2f joyLLabelSize = DrawingUtil::DrawGenericHeader("Joy L",
 			Vector2f(COL1, ROW2), false, font, Color::Green, window);
@@ -166,8 +330,11 @@ void UpdateGUI(Font& font, Server * server, RenderWindow& window) {
 
 	// Camera feed
 	mutex_cameraVars.lock();
-	for (int i = 0; i < CAM_COUNT; i++) {
-		UpdateCameraFeedGraphics(i);
+	unsigned long long allocs = AllocCounter::GetThreadAllocs();
+	UpdateCameraFeedGraphics();
+	if (AllocCounter::IsEnabled()) {
+		PROFILE_COUNT("alloc.cameraUpdate",
+				AllocCounter::GetThreadAllocs() - allocs);
 	}
 
 	// If we're not transmitting a camera feed don't display it on the window
@@ -176,21 +343,369 @@ void UpdateGUI(Font& font, Server * server, RenderWindow& window) {
 	mut_Transmit.unlock();
 
 	if (dispCam) {
-		int targetSize = 512;
-		sprite[0].setScale((double) targetSize / texture[0].getSize().x,
-				(double) targetSize / texture[0].getSize().x);
-		sprite[0].setPosition(COL3, ROW2);
-		window.draw(sprite[0]);
-		sprite[1].setScale((double) targetSize / texture[0].getSize().x,
-				(double) targetSize / texture[0].getSize().x);
-		sprite[1].setPosition(COL1, ROW4);
-		window.draw(sprite[1]);
-		sprite[2].setScale((double) targetSize / texture[0].getSize().x,
-				(double) targetSize / texture[0].getSize().x);
-		sprite[2].setPosition(COL3, ROW4);
-		window.draw(sprite[2]);
+		PROFILE_SCOPE("gui.drawCameras");
+		// Main feed to the right of the joysticks, the rest along the bottom
+		cameraAtlas.Layout(
+				FloatRect(COL3, ROW2, window.getSize().x - COL3 - 8,
+						ROW4 - ROW2 - 8),
+				FloatRect(COL1, ROW4, window.getSize().x - COL1 - 8,
+						window.getSize().y - ROW4 - 8));
+		cameraAtlas.Draw(window);
 	}
 	mutex_cameraVars.unlock();
+
+	if (showProfiler) {
+		DrawProfilerPanel(font, window);
+	}
+}
+
+/**
+ * Sends the commands for this tick's inputs, if the robot is connected
+ *
+ * @param server The server to send commands through
+ */
+void SendCommands(Server * server) {
+	unsigned long long allocs = AllocCounter::GetThreadAllocs();
+	sendAllocs = 0;
+	if (server->IsConnected()) {
+		double joyDL = IO::JoyY(JOY_L) - prevJoyL;
+		double joyDR = IO::JoyY(JOY_R) - prevJoyR;
+		double driveScale = 1.0;
+
+		// If the joystick has changed enough (prevents spam if used correctly)
+		if (sqrt(joyDL * joyDL + joyDR * joyDR) >= JOY_MIN_DELTA) {
+			prevJoyL = IO::JoyY(JOY_L) * driveScale;
+			prevJoyR = IO::JoyY(JOY_R) * driveScale;
+
+			// Get individual wheel control inputs
+			bool fl_raw = IO::JoyButton(JOY_L, 3);
+			bool rl_raw = IO::JoyButton(JOY_L, 4);
+			bool fr_raw = IO::JoyButton(JOY_R, 3);
+			bool rr_raw = IO::JoyButton(JOY_R, 4);
+
+			bool fl = (fl_raw == rl_raw) || fl_raw;
+			bool rl = (fl_raw == rl_raw) || rl_raw;
+			bool fr = (fr_raw == rr_raw) || fr_raw;
+			bool rr = (fr_raw == rr_raw) || rr_raw;
+
+			Packet& packet = commandPool.Acquire();
+			packet << DRIVE_PACKET;
+			packet << IO::JoyY(JOY_L) * driveScale;
+			packet << IO::JoyY(JOY_R) * driveScale;
+			packet << fl << rl << fr << rr;
+			SendCommand(server, packet);
+		}
+
+		if (IO::OIButton(L_STAGE1POSU)) {
+			// If anything changes/changed send refresh packet
+			if (IO::OIButtonTrig(L_STAGE1POSU)
+					|| IO::OIButtonTrig(L_STAGE1LIFTL)
+					|| IO::OIButtonTrig(L_STAGE1LIFTR)
+					|| IO::OIButtonUntrig(L_STAGE1LIFTL)
+					|| IO::OIButtonUntrig(L_STAGE1LIFTR)) {
+				// Send refresh packet
+				Packet& packet = commandPool.Acquire();
+				packet << MINER_MOVE_S1_PACKET << 1
+						<< !IO::OIButton(L_STAGE1LIFTL) * 1.0
+						<< !IO::OIButton(L_STAGE1LIFTR) * 1.0;
+				SendOICommand(server, packet);
+			}
+		} else {
+			if (IO::OIButtonUntrig(L_STAGE1POSU)) {
+				// Just stopped moving, send a stop packet
+				Packet& packet = commandPool.Acquire();
+				packet << MINER_MOVE_S1_PACKET << 0 << 0.0 << 0.0;
+				SendOICommand(server, packet);
+			}
+		}
+
+		if (IO::OIButton(L_STAGE1POSD)) {
+			// If anything changes send refresh packet
+			if (IO::OIButtonTrig(L_STAGE1POSD)
+					|| IO::OIButtonTrig(L_STAGE1LIFTL)
+					|| IO::OIButtonTrig(L_STAGE1LIFTR)
+					|| IO::OIButtonUntrig(L_STAGE1LIFTL)
+					|| IO::OIButtonUntrig(L_STAGE1LIFTR)) {
+				// Send refresh packet
+				Packet& packet = commandPool.Acquire();
+				packet << MINER_MOVE_S1_PACKET << -1
+						<< !IO::OIButton(L_STAGE1LIFTL) * -1.0
+						<< !IO::OIButton(L_STAGE1LIFTR) * -1.0;
+				SendOICommand(server, packet);
+			}
+		} else {
+			if (IO::OIButtonUntrig(L_STAGE1POSD)) {
+				// Just stopped moving, send a stop packet
+				Packet& packet = commandPool.Acquire();
+				packet << MINER_MOVE_S1_PACKET << 0 << 0.0 << 0.0;
+				SendOICommand(server, packet);
+			}
+		}
+
+		if (IO::OIButton(L_STAGE2POSU)) {
+			// If anything changes/changed send refresh packet
+			if (IO::OIButtonTrig(L_STAGE2POSU)
+					|| IO::OIButtonTrig(L_STAGE2LIFTL)
+					|| IO::OIButtonTrig(L_STAGE2LIFTR)
+					|| IO::OIButtonUntrig(L_STAGE2LIFTL)
+					|| IO::OIButtonUntrig(L_STAGE2LIFTR)) {
+				// Send refresh packet
+				Packet& packet = commandPool.Acquire();
+				packet << MINER_MOVE_S2_PACKET << 1
+						<< !IO::OIButton(L_STAGE2LIFTL) * 1.0
+						<< !IO::OIButton(L_STAGE2LIFTR) * 1.0;
+				SendOICommand(server, packet);
+			}
+		} else {
+			if (IO::OIButtonUntrig(L_STAGE2POSU)) {
+				// Just stopped moving, send a stop packet
+				Packet& packet = commandPool.Acquire();
+				packet << MINER_MOVE_S2_PACKET << 0 << 0.0 << 0.0;
+				SendOICommand(server, packet);
+			}
+		}
+
+		if (IO::OIButton(L_STAGE2POSD)) {
+			// If anything changes send refresh packet
+			if (IO::OIButtonTrig(L_STAGE2POSD)
+					|| IO::OIButtonTrig(L_STAGE2LIFTL)
+					|| IO::OIButtonTrig(L_STAGE2LIFTR)
+					|| IO::OIButtonUntrig(L_STAGE2LIFTL)
+					|| IO::OIButtonUntrig(L_STAGE2LIFTR)) {
+				// Send refresh packet
+				Packet& packet = commandPool.Acquire();
+				packet << MINER_MOVE_S2_PACKET << -1
+						<< !IO::OIButton(L_STAGE2LIFTL) * -1.0
+						<< !IO::OIButton(L_STAGE2LIFTR) * -1.0;
+				SendOICommand(server, packet);
+			}
+		} else {
+			if (IO::OIButtonUntrig(L_STAGE2POSD)) {
+				// Just stopped moving, send a stop packet
+				Packet& packet = commandPool.Acquire();
+				packet << MINER_MOVE_S2_PACKET << 0 << 0.0 << 0.0;
+				SendOICommand(server, packet);
+			}
+		}
+
+		if (IO::OIButtonTrig(CM_DUMP)) {
+			Packet& packet = commandPool.Acquire();
+			packet << MINER_SPIN_PACKET << -1;
+			SendOICommand(server, packet);
+		} else if (IO::OIButtonUntrig(CM_DUMP)) {
+			Packet& packet = commandPool.Acquire();
+			packet << MINER_SPIN_PACKET << 0;
+			SendOICommand(server, packet);
+		}
+
+		if (IO::OIButtonTrig(CM_DIG)) {
+			Packet& packet = commandPool.Acquire();
+			packet << MINER_SPIN_PACKET << 1;
+			SendOICommand(server, packet);
+		} else if (IO::OIButtonUntrig(CM_DIG)) {
+			Packet& packet = commandPool.Acquire();
+			packet << MINER_SPIN_PACKET << 0;
+			SendOICommand(server, packet);
+		}
+
+		// ----- Bin Sliding -----
+		if (IO::OIButton(B_POSOVERRIDE)) {
+			// If it was just activated kill the slide
+			if (IO::OIButtonTrig(B_POSOVERRIDE)) {
+				// Send a stop command
+				Packet& packet = commandPool.Acquire();
+				packet << BIN_SLIDE_PACKET << 0;
+				SendOICommand(server, packet);
+			}
+
+			// Enable override buttons
+			if (IO::OIButtonTrig(B_TOCOLLECT)) { // TODO: CHANGE TO MANUAL
+				Packet& packet = commandPool.Acquire();
+				packet << BIN_SLIDE_PACKET << -1;
+				SendOICommand(server, packet);
+			} else if (IO::OIButtonUntrig(B_TOCOLLECT)) { // TODO: CHANGE TO MANUAL
+				Packet& packet = commandPool.Acquire();
+				packet << BIN_SLIDE_PACKET << 0;
+				SendOICommand(server, packet);
+			}
+
+			if (IO::OIButtonTrig(B_TODUMP)) { // TODO: CHANGE TO MANUAL
+				Packet& packet = commandPool.Acquire();
+				packet << BIN_SLIDE_PACKET << 1;
+				SendOICommand(server, packet);
+			} else if (IO::OIButtonUntrig(B_TODUMP)) { // TODO: CHANGE TO MANUAL
+				Packet& packet = commandPool.Acquire();
+				packet << BIN_SLIDE_PACKET << 0;
+				SendOICommand(server, packet);
+			}
+		} else {
+			if (IO::OIButtonUntrig(B_POSOVERRIDE)) {
+				// Send a stop command
+				Packet& packet = commandPool.Acquire();
+				packet << BIN_SLIDE_PACKET << 0;
+				SendOICommand(server, packet);
+			}
+
+			if (IO::OIButtonTrig(B_TODUMP)) {
+				Packet& packet = commandPool.Acquire();
+				packet << BIN_SLIDE_PACKET << 2;
+				SendOICommand(server, packet);
+			}
+			if (IO::OIButtonTrig(B_TOCOLLECT)) {
+				Packet& packet = commandPool.Acquire();
+				packet << BIN_SLIDE_PACKET << -2;
+				SendOICommand(server, packet);
+			}
+		}
+
+		if (IO::OIButtonTrig(C_DUMP)) {
+			Packet& packet = commandPool.Acquire();
+			packet << CONVEYOR_PACKET << 1;
+			SendOICommand(server, packet);
+		} else if (IO::OIButtonUntrig(C_DUMP)) {
+			Packet& packet = commandPool.Acquire();
+			packet << CONVEYOR_PACKET << 0;
+			SendOICommand(server, packet);
+		}
+
+		if (IO::OIButtonTrig(C_REV)) {
+			Packet& packet = commandPool.Acquire();
+			packet << CONVEYOR_PACKET << -1;
+			SendOICommand(server, packet);
+		} else if (IO::OIButtonUntrig(C_REV)) {
+			Packet& packet = commandPool.Acquire();
+			packet << CONVEYOR_PACKET << 0;
+			SendOICommand(server, packet);
+		}
+
+		// Camera feed toggling
+		if (IO::OIButtonTrig(CM_LEVELCM) || (prevKeyT && !currKeyT)) {
+			sf::Lock lock(mut_Transmit);
+			transmit = !transmit;
+			AsyncLog::Log(AsyncLog::LEVEL_INFO, "Camera transmit {}",
+					transmit ? "on" : "off");
+			Packet& packet = commandPool.Acquire();
+			packet << CONVEYOR_PACKET + 1 << transmit;
+			SendOICommand(server, packet);
+		}
+	}
+	if (AllocCounter::IsEnabled()) {
+		// alloc.commands should stay at 0 once the pool has warmed up.
+		// alloc.send is never 0 for a tick that sent anything: SFML's
+		// TcpSocket::send(Packet&) copies every packet into a newly
+		// allocated block, which the packet pool can't help with
+		PROFILE_COUNT("alloc.commands",
+				AllocCounter::GetThreadAllocs() - allocs - sendAllocs);
+		PROFILE_COUNT("alloc.send", sendAllocs);
+	}
+}
+
+/**
+ * Plays back any due script events and updates the IO state for this tick
+ */
+void UpdateInputs() {
+	// Like pendingOIChange, only this tick's commands can answer it, so
+	// events that didn't lead to a command aren't timed against a later one
+	pendingScriptInput = 0;
+	if (useInputScript
+			&& inputScript.Update(
+					inputScriptClock.getElapsedTime().asMilliseconds())) {
+		pendingScriptInput = Profiler::Now();
+	}
+
+	IO::UpdateButtonStates();
+	pendingOIChange = IO::TakeOIChangeTime();
+}
+
+/**
+ * Gets the CPU time used by the whole process so far
+ *
+ * @return The user and system time in seconds
+ */
+double ProcessCPUTime() {
+	struct rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage) != 0) {
+		return 0.0;
+	}
+	return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1000000.0
+			+ usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1000000.0;
+}
+
+/**
+ * Stops headless mode on SIGINT/SIGTERM
+ */
+void StopHeadless(int) {
+	headlessRunning = 0;
+}
+
+/**
+ * The method called once the headless thread starts. Runs the input and
+ * command path at a fixed rate without a window, reporting throughput and
+ * CPU usage every second.
+ *
+ * @param serv The server to send commands through
+ */
+void * HeadlessThread(void * serv) {
+	Server* server = (Server*) serv;
+
+	Clock runClock;
+	Clock reportClock;
+	double reportCPU = ProcessCPUTime();
+	unsigned long long ticks = 0;
+	unsigned long long reportTicks = 0, reportCommands = 0, reportBytes = 0;
+
+	while (headlessRunning) {
+		sf::Int64 tickStart = Profiler::Now();
+		{
+			PROFILE_SCOPE("frame");
+			UpdateInputs();
+			SendCommands(server);
+		}
+		ticks++;
+
+		if ((headlessDuration > 0
+				&& runClock.getElapsedTime().asSeconds() >= headlessDuration)
+				|| (headlessDuration <= 0 && useInputScript
+						&& inputScript.IsFinished())) {
+			break;
+		}
+
+		if (reportClock.getElapsedTime().asSeconds() >= 1.0) {
+			double seconds = reportClock.restart().asSeconds();
+			double cpu = ProcessCPUTime();
+			// At most LOG_MAX_ARGS arguments, so the link state picks the format
+			AsyncLog::Log(AsyncLog::LEVEL_INFO,
+					server->IsConnected() ?
+							"Headless: {} ticks/s, {} commands/s, {} bytes/s, {}% CPU" :
+							"Headless: {} ticks/s, {} commands/s, {} bytes/s, {}% CPU, not connected",
+					(ticks - reportTicks) / seconds,
+					(commandsSent - reportCommands) / seconds,
+					(commandBytesSent - reportBytes) / seconds,
+					100.0 * (cpu - reportCPU) / seconds);
+			reportTicks = ticks;
+			reportCommands = commandsSent;
+			reportBytes = commandBytesSent;
+			reportCPU = cpu;
+		}
+
+		// A rate of 0 runs as fast as possible
+		if (headlessRate > 0) {
+			sf::Int64 remaining = tickStart + 1000000 / headlessRate
+					- Profiler::Now();
+			if (remaining > 0) {
+				sf::sleep(sf::microseconds(remaining));
+			}
+		}
+	}
+
+	double seconds = runClock.getElapsedTime().asSeconds();
+	AsyncLog::Log(AsyncLog::LEVEL_INFO, "Headless run: {} ticks in {} s", ticks,
+			seconds);
+	AsyncLog::Log(AsyncLog::LEVEL_INFO,
+			"Headless run: {} commands ({} commands/s), {} bytes", commandsSent,
+			seconds > 0 ? commandsSent / seconds : 0.0, commandBytesSent);
+
+	return NULL;
 }
 
 /**
@@ -208,17 +723,27 @@ void * WindowThread(void * serv) {
 
 	RenderWindow window(VideoMode(1000, 768), "TrickFire Robotics - Server");
 
+	// Pick up any joysticks that were plugged in before the window existed
+	IO::ScanJoysticks();
+
 	while (window.isOpen()) {
+		PROFILE_SCOPE("frame");
 		Event event;
 		while (window.pollEvent(event)) {
 			// Handle system windon events
 			if (event.type == sf::Event::Closed) {
 				window.close();
+			} else if (event.type == sf::Event::JoystickConnected
+					|| event.type == sf::Event::JoystickDisconnected) {
+				IO::HandleJoyEvent(event);
+			} else if (event.type == sf::Event::KeyPressed
+					&& event.key.code == Keyboard::F3) {
+				showProfiler = !showProfiler;
 			}
 		}
 
 		// Tell IO to track button states/changes
-		IO::UpdateButtonStates();
+		UpdateInputs();
 
 		// Update the GUI
 		UpdateGUI(wlmCarton, server, window);
@@ -242,246 +767,141 @@ void * WindowThread(void * serv) {
 		}
 
 		// Draw the changes to the window
-		window.display();
+		{
+			PROFILE_SCOPE("gui.display");
+			window.display();
+		}
 
 		// Handle input if the robot is actually connected
-		if (server->IsConnected()) {
-			double joyDL = IO::JoyY(JOY_L) - prevJoyL;
-			double joyDR = IO::JoyY(JOY_R) - prevJoyR;
-			double driveScale = 1.0;
-
-			// If the joystick has changed enough (prevents spam if used correctly)
-			if (sqrt(joyDL * joyDL + joyDR * joyDR) >= JOY_MIN_DELTA) {
-				prevJoyL = IO::JoyY(JOY_L) * driveScale;
-				prevJoyR = IO::JoyY(JOY_R) * driveScale;
-
-				// Get individual wheel control inputs
-				bool fl_raw = IO::JoyButton(JOY_L, 3);
-				bool rl_raw = IO::JoyButton(JOY_L, 4);
-				bool fr_raw = IO::JoyButton(JOY_R, 3);
-				bool rr_raw = IO::JoyButton(JOY_R, 4);
-
-				bool fl = (fl_raw == rl_raw) || fl_raw;
-				bool rl = (fl_raw == rl_raw) || rl_raw;
-				bool fr = (fr_raw == rr_raw) || fr_raw;
-				bool rr = (fr_raw == rr_raw) || rr_raw;
-
-				Packet packet;
-				packet << DRIVE_PACKET;
-				packet << IO::JoyY(JOY_L) * driveScale;
-				packet << IO::JoyY(JOY_R) * driveScale;
-				packet << fl << rl << fr << rr;
-				server->Send(packet);
-			}
+		SendCommands(server);
+	}
 
-			if (IO::OIButton(L_STAGE1POSU)) {
-				// If anything changes/changed send refresh packet
-				if (IO::OIButtonTrig(L_STAGE1POSU)
-						|| IO::OIButtonTrig(L_STAGE1LIFTL)
-						|| IO::OIButtonTrig(L_STAGE1LIFTR)
-						|| IO::OIButtonUntrig(L_STAGE1LIFTL)
-						|| IO::OIButtonUntrig(L_STAGE1LIFTR)) {
-					// Send refresh packet
-					Packet packet;
-					packet << MINER_MOVE_S1_PACKET << 1
-							<< !IO::OIButton(L_STAGE1LIFTL) * 1.0
-							<< !IO::OIButton(L_STAGE1LIFTR) * 1.0;
-					server->Send(packet);
-				}
-			} else {
-				if (IO::OIButtonUntrig(L_STAGE1POSU)) {
-					// Just stopped moving, send a stop packet
-					Packet packet;
-					packet << MINER_MOVE_S1_PACKET << 0 << 0.0 << 0.0;
-					server->Send(packet);
-				}
-			}
+	return NULL;
+}
 
-			if (IO::OIButton(L_STAGE1POSD)) {
-				// If anything changes send refresh packet
-				if (IO::OIButtonTrig(L_STAGE1POSD)
-						|| IO::OIButtonTrig(L_STAGE1LIFTL)
-						|| IO::OIButtonTrig(L_STAGE1LIFTR)
-						|| IO::OIButtonUntrig(L_STAGE1LIFTL)
-						|| IO::OIButtonUntrig(L_STAGE1LIFTR)) {
-					// Send refresh packet
-					Packet packet;
-					packet << MINER_MOVE_S1_PACKET << -1
-							<< !IO::OIButton(L_STAGE1LIFTL) * -1.0
-							<< !IO::OIButton(L_STAGE1LIFTR) * -1.0;
-					server->Send(packet);
-				}
-			} else {
-				if (IO::OIButtonUntrig(L_STAGE1POSD)) {
-					// Just stopped moving, send a stop packet
-					Packet packet;
-					packet << MINER_MOVE_S1_PACKET << 0 << 0.0 << 0.0;
-					server->Send(packet);
-				}
-			}
+int main(int argc, char ** argv) {
+	Logger::SetLoggingLevel(Logger::LEVEL_INFO_FINE);
 
-			if (IO::OIButton(L_STAGE2POSU)) {
-				// If anything changes/changed send refresh packet
-				if (IO::OIButtonTrig(L_STAGE2POSU)
-						|| IO::OIButtonTrig(L_STAGE2LIFTL)
-						|| IO::OIButtonTrig(L_STAGE2LIFTR)
-						|| IO::OIButtonUntrig(L_STAGE2LIFTL)
-						|| IO::OIButtonUntrig(L_STAGE2LIFTR)) {
-					// Send refresh packet
-					Packet packet;
-					packet << MINER_MOVE_S2_PACKET << 1
-							<< !IO::OIButton(L_STAGE2LIFTL) * 1.0
-							<< !IO::OIButton(L_STAGE2LIFTR) * 1.0;
-					server->Send(packet);
-				}
-			} else {
-				if (IO::OIButtonUntrig(L_STAGE2POSU)) {
-					// Just stopped moving, send a stop packet
-					Packet packet;
-					packet << MINER_MOVE_S2_PACKET << 0 << 0.0 << 0.0;
-					server->Send(packet);
-				}
+	// Joystick layout can be overridden with --joysticks N and --buttons N,
+	// logging with --log-level LEVEL and --log-file PATH, the profile
+	// dump written on exit with --profile-file PATH and camera limits with
+	// --cam-max-size COLS ROWS and --cam-mem-cap CAM BYTES (CAM is a camera
+	// index or "all", later ones win) and the OI link with --oi-port PATH
+	// and --oi-baud RATE.
+	//
+	// --script PATH replaces the joysticks and OI with a recorded input
+	// script (--script-loop to repeat it), and --headless runs without a
+	// window at --rate HZ (0 for unlimited) for --duration SECONDS. Commands
+	// are only sent while a robot is connected, tools/robot_standin can
+	// stand in for one
+	unsigned int joyCount = JOY_DEFAULT_COUNT;
+	unsigned int joyButtons = JOY_DEFAULT_BUTTONS;
+	AsyncLog::Level logLevel = AsyncLog::LEVEL_INFO;
+	string logFile;
+	string profileFile = "profile.txt";
+	string oiPort = OI_DEFAULT_PORT;
+	int oiBaud = OI_DEFAULT_BAUD;
+	int camMaxCols = CAM_MAX_COLS;
+	int camMaxRows = CAM_MAX_ROWS;
+	size_t camMemCap[CAM_COUNT] = { 0 };
+	string scriptFile;
+	bool scriptLoop = false;
+	bool headless = false;
+	for (int i = 1; i < argc; i++) {
+		string arg = argv[i];
+		bool hasValue = i + 1 < argc;
+		if (arg == "--joysticks" && hasValue) {
+			joyCount = atoi(argv[++i]);
+		} else if (arg == "--buttons" && hasValue) {
+			joyButtons = atoi(argv[++i]);
+		} else if (arg == "--log-level" && hasValue) {
+			if (!AsyncLog::ParseLevel(argv[++i], logLevel)) {
+				cerr << "Unknown log level " << argv[i] << endl;
 			}
-
-			if (IO::OIButton(L_STAGE2POSD)) {
-				// If anything changes send refresh packet
-				if (IO::OIButtonTrig(L_STAGE2POSD)
-						|| IO::OIButtonTrig(L_STAGE2LIFTL)
-						|| IO::OIButtonTrig(L_STAGE2LIFTR)
-						|| IO::OIButtonUntrig(L_STAGE2LIFTL)
-						|| IO::OIButtonUntrig(L_STAGE2LIFTR)) {
-					// Send refresh packet
-					Packet packet;
-					packet << MINER_MOVE_S2_PACKET << -1
-							<< !IO::OIButton(L_STAGE2LIFTL) * -1.0
-							<< !IO::OIButton(L_STAGE2LIFTR) * -1.0;
-					server->Send(packet);
+		} else if (arg == "--log-file" && hasValue) {
+			logFile = argv[++i];
+		} else if (arg == "--profile-file" && hasValue) {
+			profileFile = argv[++i];
+		} else if (arg == "--cam-max-size" && i + 2 < argc) {
+			camMaxCols = atoi(argv[++i]);
+			camMaxRows = atoi(argv[++i]);
+		} else if (arg == "--cam-mem-cap" && i + 2 < argc) {
+			string cam = argv[++i];
+			size_t bytes = strtoul(argv[++i], NULL, 10);
+			char * end;
+			long index = strtol(cam.c_str(), &end, 10);
+			if (cam == "all") {
+				for (int c = 0; c < CAM_COUNT; c++) {
+					camMemCap[c] = bytes;
 				}
+			} else if (!cam.empty() && *end == '\0' && index >= 0
+					&& index < CAM_COUNT) {
+				camMemCap[index] = bytes;
 			} else {
-				if (IO::OIButtonUntrig(L_STAGE2POSD)) {
-					// Just stopped moving, send a stop packet
-					Packet packet;
-					packet << MINER_MOVE_S2_PACKET << 0 << 0.0 << 0.0;
-					server->Send(packet);
-				}
-			}
-
-			if (IO::OIButtonTrig(CM_DUMP)) {
-				Packet packet;
-				packet << MINER_SPIN_PACKET << -1;
-				server->Send(packet);
-			} else if (IO::OIButtonUntrig(CM_DUMP)) {
-				Packet packet;
-				packet << MINER_SPIN_PACKET << 0;
-				server->Send(packet);
+				cerr << "Unknown camera " << cam << endl;
 			}
+		} else if (arg == "--oi-port" && hasValue) {
+			oiPort = argv[++i];
+		} else if (arg == "--oi-baud" && hasValue) {
+			oiBaud = atoi(argv[++i]);
+		} else if (arg == "--script" && hasValue) {
+			scriptFile = argv[++i];
+		} else if (arg == "--script-loop") {
+			scriptLoop = true;
+		} else if (arg == "--headless") {
+			headless = true;
+		} else if (arg == "--rate" && hasValue) {
+			headlessRate = atoi(argv[++i]);
+		} else if (arg == "--duration" && hasValue) {
+			headlessDuration = atof(argv[++i]);
+		} else {
+			cerr << "Unknown argument " << arg << endl;
+		}
+	}
 
-			if (IO::OIButtonTrig(CM_DIG)) {
-				Packet packet;
-				packet << MINER_SPIN_PACKET << 1;
-				server->Send(packet);
-			} else if (IO::OIButtonUntrig(CM_DIG)) {
-				Packet packet;
-				packet << MINER_SPIN_PACKET << 0;
-				server->Send(packet);
-			}
-
-			// ----- Bin Sliding -----
-			if (IO::OIButton(B_POSOVERRIDE)) {
-				// If it was just activated kill the slide
-				if (IO::OIButtonTrig(B_POSOVERRIDE)) {
-					// Send a stop command
-					Packet packet;
-					packet << BIN_SLIDE_PACKET << 0;
-					server->Send(packet);
-				}
-
-				// Enable override buttons
-				if (IO::OIButtonTrig(B_TOCOLLECT)) { // TODO: CHANGE TO MANUAL
-					Packet packet;
-					packet << BIN_SLIDE_PACKET << -1;
-					server->Send(packet);
-				} else if (IO::OIButtonUntrig(B_TOCOLLECT)) { // TODO: CHANGE TO MANUAL
-					Packet packet;
-					packet << BIN_SLIDE_PACKET << 0;
-					server->Send(packet);
-				}
-
-				if (IO::OIButtonTrig(B_TODUMP)) { // TODO: CHANGE TO MANUAL
-					Packet packet;
-					packet << BIN_SLIDE_PACKET << 1;
-					server->Send(packet);
-				} else if (IO::OIButtonUntrig(B_TODUMP)) { // TODO: CHANGE TO MANUAL
-					Packet packet;
-					packet << BIN_SLIDE_PACKET << 0;
-					server->Send(packet);
-				}
-			} else {
-				if (IO::OIButtonUntrig(B_POSOVERRIDE)) {
-					// Send a stop command
-					Packet packet;
-					packet << BIN_SLIDE_PACKET << 0;
-					server->Send(packet);
-				}
-
-				if (IO::OIButtonTrig(B_TODUMP)) {
-					Packet packet;
-					packet << BIN_SLIDE_PACKET << 2;
-					server->Send(packet);
-				}
-				if (IO::OIButtonTrig(B_TOCOLLECT)) {
-					Packet packet;
-					packet << BIN_SLIDE_PACKET << -2;
-					server->Send(packet);
-				}
-			}
+	AsyncLog::SetLevel(logLevel);
+	AsyncLog::Start(logFile);
 
-			if (IO::OIButtonTrig(C_DUMP)) {
-				Packet packet;
-				packet << CONVEYOR_PACKET << 1;
-				server->Send(packet);
-			} else if (IO::OIButtonUntrig(C_DUMP)) {
-				Packet packet;
-				packet << CONVEYOR_PACKET << 0;
-				server->Send(packet);
-			}
+	IO::SetJoyConfig(joyCount, joyButtons);
 
-			if (IO::OIButtonTrig(C_REV)) {
-				Packet packet;
-				packet << CONVEYOR_PACKET << -1;
-				server->Send(packet);
-			} else if (IO::OIButtonUntrig(C_REV)) {
-				Packet packet;
-				packet << CONVEYOR_PACKET << 0;
-				server->Send(packet);
-			}
+	// Camera frames bigger than this are rejected rather than allocated
+	CameraIngest::SetMaxResolution(camMaxCols, camMaxRows);
+	for (int i = 0; i < CAM_COUNT; i++) {
+		CameraIngest::SetMemoryCap(i, camMemCap[i]);
+	}
 
-			// Camera feed toggling
-			if (IO::OIButtonTrig(CM_LEVELCM) || (prevKeyT && !currKeyT)) {
-				sf::Lock lock(mut_Transmit);
-				transmit = !transmit;
-				Packet packet;
-				packet << CONVEYOR_PACKET + 1 << transmit;
-				server->Send(packet);
-			}
+	if (!scriptFile.empty()) {
+		if (!inputScript.Load(scriptFile)) {
+			AsyncLog::Stop();
+			return 1;
 		}
+		inputScript.SetLooping(scriptLoop);
+		useInputScript = true;
+		AsyncLog::Log(AsyncLog::LEVEL_INFO, "Loaded input script ({} events)",
+				inputScript.GetEventCount());
 	}
 
-	return NULL;
-}
-
-int main() {
-	Logger::SetLoggingLevel(Logger::LEVEL_INFO_FINE);
+	// There's no keyboard to fall back on without a window either
+	IO::SetScriptedInput(useInputScript || headless);
 
-	IO::StartOI();
+	if (!useInputScript) {
+		IO::StartOI(oiPort, oiBaud);
+	}
 
 	// Start the server
 	Server server(25565);
 	server.SetMessageCallback(PacketReceived);
 
+	if (headless) {
+		signal(SIGINT, StopHeadless);
+		signal(SIGTERM, StopHeadless);
+	}
+
+	inputScriptClock.restart();
 
 	pthread_t windowThread;
-	pthread_create(&windowThread, NULL, WindowThread, (void *) &server);
+	pthread_create(&windowThread, NULL, headless ? HeadlessThread : WindowThread,
+			(void *) &server);
 
 	pthread_join(windowThread, NULL);
 
@@ -489,5 +909,11 @@ int main() {
 
 	IO::StopOI();
 
+	if (!Profiler::Dump(profileFile)) {
+		AsyncLog::Log(AsyncLog::LEVEL_ERROR, "Failed to write profile");
+	}
+
+	AsyncLog::Stop();
+
 	return 0;
 }
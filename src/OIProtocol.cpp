@@ -0,0 +1,147 @@
+#include "OIProtocol.h"
+
+namespace trickfire {
+
+OIParser::OIParser() :
+		encodedSize(0), overrun(false), payloadSize(0), sequence(0), synced(
+				false), frames(0), errors(0), lost(0) {
+}
+
+OIParser::Result OIParser::Push(sf::Uint8 byte) {
+	if (byte == 0) {
+		Result result = Finish();
+		encodedSize = 0;
+		overrun = false;
+		return result;
+	}
+
+	if (overrun) {
+		// Already reported, wait for the next delimiter to resync
+		return RESULT_NONE;
+	}
+
+	if (encodedSize >= OI_MAX_ENCODED_FRAME) {
+		overrun = true;
+		errors++;
+		return RESULT_OVERRUN;
+	}
+
+	encoded[encodedSize++] = byte;
+	return RESULT_NONE;
+}
+
+void OIParser::Resync() {
+	// Ignore everything up to the next delimiter, the way an overrun does,
+	// and don't count the gap in sequence numbers as lost frames
+	encodedSize = 0;
+	overrun = true;
+	synced = false;
+}
+
+OIParser::Result OIParser::Finish() {
+	if (overrun) {
+		return RESULT_NONE;
+	}
+	if (encodedSize == 0) {
+		// Back to back delimiters, nothing to do
+		return RESULT_NONE;
+	}
+
+	// COBS decode into raw
+	unsigned int rawSize = 0;
+	unsigned int i = 0;
+	while (i < encodedSize) {
+		unsigned int code = encoded[i++];
+		for (unsigned int j = 1; j < code; j++) {
+			if (i >= encodedSize || rawSize >= OI_MAX_RAW_FRAME) {
+				errors++;
+				return RESULT_BAD_FRAME;
+			}
+			raw[rawSize++] = encoded[i++];
+		}
+		if (code < 0xFF && i < encodedSize) {
+			if (rawSize >= OI_MAX_RAW_FRAME) {
+				errors++;
+				return RESULT_BAD_FRAME;
+			}
+			raw[rawSize++] = 0;
+		}
+	}
+
+	// Version, sequence, at least one payload byte and the CRC
+	if (rawSize < 4 || raw[0] != OI_PROTOCOL_VERSION) {
+		errors++;
+		return RESULT_BAD_FRAME;
+	}
+
+	if (Crc8(raw, rawSize - 1) != raw[rawSize - 1]) {
+		errors++;
+		return RESULT_BAD_CRC;
+	}
+
+	sf::Uint8 newSequence = raw[1];
+	if (synced) {
+		lost += (sf::Uint8) (newSequence - sequence - 1);
+	}
+	sequence = newSequence;
+	synced = true;
+
+	payloadSize = rawSize - 3;
+	frames++;
+	return RESULT_FRAME;
+}
+
+sf::Uint8 OIParser::Crc8(const sf::Uint8 * data, unsigned int size) {
+	// CRC-8/ATM, polynomial x^8 + x^2 + x + 1
+	sf::Uint8 crc = 0;
+	for (unsigned int i = 0; i < size; i++) {
+		crc ^= data[i];
+		for (int bit = 0; bit < 8; bit++) {
+			crc = (crc & 0x80) ? (sf::Uint8) ((crc << 1) ^ 0x07) : crc << 1;
+		}
+	}
+	return crc;
+}
+
+unsigned int OIParser::Encode(const sf::Uint8 * payload, unsigned int size,
+		sf::Uint8 sequence, sf::Uint8 * out) {
+	// out must hold at least OI_MAX_ENCODED_FRAME + 1 bytes
+	if (size == 0 || size > OI_MAX_PAYLOAD) {
+		return 0;
+	}
+
+	sf::Uint8 frame[OI_MAX_RAW_FRAME];
+	unsigned int frameSize = 0;
+	frame[frameSize++] = OI_PROTOCOL_VERSION;
+	frame[frameSize++] = sequence;
+	for (unsigned int i = 0; i < size; i++) {
+		frame[frameSize++] = payload[i];
+	}
+	frame[frameSize] = Crc8(frame, frameSize);
+	frameSize++;
+
+	// COBS encode, then the delimiter
+	unsigned int outSize = 1;
+	unsigned int codeIndex = 0;
+	sf::Uint8 code = 1;
+	for (unsigned int i = 0; i < frameSize; i++) {
+		if (frame[i] == 0) {
+			out[codeIndex] = code;
+			codeIndex = outSize++;
+			code = 1;
+		} else {
+			out[outSize++] = frame[i];
+			code++;
+			if (code == 0xFF) {
+				out[codeIndex] = code;
+				codeIndex = outSize++;
+				code = 1;
+			}
+		}
+	}
+	out[codeIndex] = code;
+	out[outSize++] = 0;
+	return outSize;
+}
+
+}
@@ -0,0 +1,74 @@
+#ifndef OIPROTOCOL_H_
+#define OIPROTOCOL_H_
+
+// OI serial protocol v2. Each frame is
+//   [version][sequence][payload...][crc8]
+// COBS encoded and terminated by a single 0x00, so payload bytes can take any
+// value and a lost byte costs at most the frame it was in.
+#define OI_PROTOCOL_VERSION 2
+#define OI_MAX_PAYLOAD 8
+#define OI_MAX_RAW_FRAME (OI_MAX_PAYLOAD + 3)
+#define OI_MAX_ENCODED_FRAME (OI_MAX_RAW_FRAME + OI_MAX_RAW_FRAME / 254 + 1)
+
+#include <SFML/System.hpp>
+
+namespace trickfire {
+
+/**
+ * Incremental parser for OI v2 frames. Bytes are pushed in one at a time as
+ * they come off the serial port and a frame is reported once its delimiter
+ * arrives and it passes the length, version and CRC checks.
+ */
+class OIParser {
+public:
+	enum Result {
+		RESULT_NONE, RESULT_FRAME, RESULT_BAD_FRAME, RESULT_BAD_CRC,
+		RESULT_OVERRUN
+	};
+
+	OIParser();
+
+	Result Push(sf::Uint8 byte);
+	void Resync();
+
+	inline const sf::Uint8 * GetPayload() const {
+		return raw + 2;
+	}
+	inline unsigned int GetPayloadSize() const {
+		return payloadSize;
+	}
+
+	inline unsigned long long GetFrameCount() const {
+		return frames;
+	}
+	inline unsigned long long GetErrorCount() const {
+		return errors;
+	}
+	inline unsigned long long GetLostCount() const {
+		return lost;
+	}
+
+	static sf::Uint8 Crc8(const sf::Uint8 * data, unsigned int size);
+	static unsigned int Encode(const sf::Uint8 * payload, unsigned int size,
+			sf::Uint8 sequence, sf::Uint8 * out);
+
+private:
+	sf::Uint8 encoded[OI_MAX_ENCODED_FRAME];
+	unsigned int encodedSize;
+	bool overrun;
+
+	sf::Uint8 raw[OI_MAX_RAW_FRAME];
+	unsigned int payloadSize;
+	sf::Uint8 sequence;
+	bool synced;
+
+	unsigned long long frames;
+	unsigned long long errors;
+	unsigned long long lost;
+
+	Result Finish();
+};
+
+}
+
+#endif
@@ -0,0 +1,22 @@
+#include "PacketPool.h"
+
+namespace trickfire {
+
+PacketPool::PacketPool(unsigned int size, std::size_t reserve) :
+		packets(size), next(0) {
+	// Grow every buffer up front so the first commands don't allocate either
+	std::vector<char> zeros(reserve);
+	for (unsigned int i = 0; i < packets.size(); i++) {
+		packets[i].append(zeros.data(), zeros.size());
+		packets[i].clear();
+	}
+}
+
+sf::Packet& PacketPool::Acquire() {
+	sf::Packet& packet = packets[next];
+	next = (next + 1) % packets.size();
+	packet.clear();
+	return packet;
+}
+
+}
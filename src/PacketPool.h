@@ -0,0 +1,30 @@
+#ifndef PACKETPOOL_H_
+#define PACKETPOOL_H_
+
+#include <vector>
+#include <SFML/Network.hpp>
+
+namespace trickfire {
+
+/**
+ * A fixed ring of reusable packets. Clearing an sf::Packet keeps its buffer,
+ * so once every packet has grown to the largest command they stop
+ * allocating.
+ *
+ * A packet handed out by Acquire stays valid until the ring wraps around, so
+ * the pool must be larger than the number of packets in flight at once.
+ */
+class PacketPool {
+public:
+	PacketPool(unsigned int size, std::size_t reserve);
+
+	sf::Packet& Acquire();
+
+private:
+	std::vector<sf::Packet> packets;
+	unsigned int next;
+};
+
+}
+
+#endif
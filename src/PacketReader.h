@@ -0,0 +1,63 @@
+#ifndef PACKETREADER_H_
+#define PACKETREADER_H_
+
+#include <cstring>
+#include <arpa/inet.h>
+#include <SFML/System.hpp>
+
+namespace trickfire {
+
+/**
+ * Bounds checked reader over the raw payload of a received packet. Values are
+ * decoded the same way sf::Packet writes them (network byte order), but every
+ * read reports whether the payload was long enough instead of silently
+ * handing back garbage.
+ */
+class PacketReader {
+public:
+	PacketReader(const void * data, std::size_t size) :
+			data((const sf::Uint8 *) data), size(data == NULL ? 0 : size), offset(
+					0) {
+	}
+
+	inline bool AtEnd() const {
+		return offset >= size;
+	}
+
+	inline std::size_t Remaining() const {
+		return size - offset;
+	}
+
+	inline void SkipToEnd() {
+		offset = size;
+	}
+
+	inline bool ReadInt32(sf::Int32& value) {
+		sf::Uint32 raw;
+		if (!ReadBytes(&raw, sizeof(raw))) {
+			return false;
+		}
+		value = (sf::Int32) ntohl(raw);
+		return true;
+	}
+
+	inline bool ReadBytes(void * out, std::size_t count) {
+		if (count > Remaining()) {
+			// Don't try to make sense of anything after a short read
+			SkipToEnd();
+			return false;
+		}
+		memcpy(out, data + offset, count);
+		offset += count;
+		return true;
+	}
+
+private:
+	const sf::Uint8 * data;
+	std::size_t size;
+	std::size_t offset;
+};
+
+}
+
+#endif
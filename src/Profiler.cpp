@@ -0,0 +1,145 @@
+#include "Profiler.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+
+#include "AsyncLog.h"
+
+namespace trickfire {
+
+sf::Clock Profiler::clock;
+thread_local Profiler::ThreadStats * Profiler::localStats = NULL;
+std::vector<Profiler::ThreadStats *> Profiler::threads;
+const char * Profiler::names[PROFILE_MAX_STATS];
+bool Profiler::timers[PROFILE_MAX_STATS];
+std::atomic<unsigned int> Profiler::statCount(0);
+sf::Mutex Profiler::mutex_registry;
+
+unsigned int Profiler::Register(const char * name, bool timer) {
+	sf::Lock lock(mutex_registry);
+
+	// The same name from two call sites shares one stat
+	unsigned int count = statCount.load();
+	for (unsigned int i = 0; i < count; i++) {
+		if (strcmp(names[i], name) == 0) {
+			return i;
+		}
+	}
+
+	if (count >= PROFILE_MAX_STATS - 1) {
+		// Out of slots, so everything else shares the last one under a name
+		// that says so rather than being reported as some other stat
+		if (count == PROFILE_MAX_STATS - 1) {
+			names[count] = "(overflow)";
+			timers[count] = false;
+			statCount.store(count + 1);
+			AsyncLog::Log(AsyncLog::LEVEL_WARNING,
+					"Profiler out of stats, {} and later ones go to (overflow)",
+					name);
+		}
+		return PROFILE_MAX_STATS - 1;
+	}
+
+	names[count] = name;
+	timers[count] = timer;
+	statCount.store(count + 1);
+	return count;
+}
+
+Profiler::ThreadStats * Profiler::RegisterThread() {
+	ThreadStats * stats = new ThreadStats();
+	for (unsigned int i = 0; i < PROFILE_MAX_STATS; i++) {
+		stats->stats[i].count = 0;
+		stats->stats[i].total = 0;
+		stats->stats[i].max = 0;
+		for (unsigned int b = 0; b < PROFILE_BUCKETS; b++) {
+			stats->stats[i].buckets[b] = 0;
+		}
+	}
+
+	sf::Lock lock(mutex_registry);
+	threads.push_back(stats);
+	return stats;
+}
+
+void Profiler::Snapshot(std::vector<Summary>& out) {
+	sf::Lock lock(mutex_registry);
+
+	unsigned int count = statCount.load();
+	out.resize(count);
+	for (unsigned int i = 0; i < count; i++) {
+		Summary& summary = out[i];
+		summary.name = names[i];
+		summary.timer = timers[i];
+		summary.count = 0;
+		summary.total = 0;
+		summary.max = 0;
+
+		sf::Uint64 buckets[PROFILE_BUCKETS] = { 0 };
+		for (unsigned int t = 0; t < threads.size(); t++) {
+			const Stat& stat = threads[t]->stats[i];
+			summary.count += stat.count.load(std::memory_order_relaxed);
+			summary.total += stat.total.load(std::memory_order_relaxed);
+			summary.max = std::max(summary.max,
+					(sf::Uint64) stat.max.load(std::memory_order_relaxed));
+			for (unsigned int b = 0; b < PROFILE_BUCKETS; b++) {
+				buckets[b] += stat.buckets[b].load(std::memory_order_relaxed);
+			}
+		}
+
+		summary.p50 = Percentile(buckets, summary.count, 0.50);
+		summary.p99 = Percentile(buckets, summary.count, 0.99);
+	}
+}
+
+bool Profiler::Dump(const std::string& file) {
+	std::ofstream out(file.c_str());
+	if (!out.is_open()) {
+		return false;
+	}
+
+	std::vector<Summary> summaries;
+	Snapshot(summaries);
+
+	out << std::left << std::setw(28) << "name" << std::right << std::setw(12)
+			<< "count" << std::setw(14) << "total" << std::setw(10) << "avg"
+			<< std::setw(10) << "p50<=" << std::setw(10) << "p99<="
+			<< std::setw(10) << "max" << std::endl;
+	for (unsigned int i = 0; i < summaries.size(); i++) {
+		const Summary& s = summaries[i];
+		out << std::left << std::setw(28) << s.name << std::right
+				<< std::setw(12) << s.count << std::setw(14) << s.total
+				<< std::setw(10) << (s.count > 0 ? s.total / s.count : 0);
+		if (s.timer) {
+			out << std::setw(10) << s.p50 << std::setw(10) << s.p99;
+		} else {
+			out << std::setw(10) << "-" << std::setw(10) << "-";
+		}
+		out << std::setw(10) << s.max << std::endl;
+	}
+	out << "(timers in microseconds)" << std::endl;
+
+	return true;
+}
+
+sf::Uint64 Profiler::Percentile(const sf::Uint64 * buckets, sf::Uint64 count,
+		double fraction) {
+	if (count == 0) {
+		return 0;
+	}
+
+	// Report the upper bound of the bucket the percentile lands in
+	sf::Uint64 target = (sf::Uint64) (count * fraction);
+	sf::Uint64 seen = 0;
+	for (unsigned int b = 0; b < PROFILE_BUCKETS; b++) {
+		seen += buckets[b];
+		if (seen > target) {
+			return b == 0 ? 0 : ((sf::Uint64) 1 << b) - 1;
+		}
+	}
+	return ((sf::Uint64) 1 << (PROFILE_BUCKETS - 1)) - 1;
+}
+
+}
@@ -0,0 +1,144 @@
+#ifndef PROFILER_H_
+#define PROFILER_H_
+
+// Set to 0 (or build with -DPROFILE=0) to compile all PROFILE_* macros out
+#ifndef PROFILE
+#define PROFILE 1
+#endif
+#define PROFILE_MAX_STATS 64
+// Power of two microsecond buckets, the last one catches everything above
+#define PROFILE_BUCKETS 24
+
+#include <atomic>
+#include <string>
+#include <vector>
+#include <SFML/System.hpp>
+
+namespace trickfire {
+
+/**
+ * Low overhead timers and counters for the hot paths. Every thread records
+ * into its own block of histograms, so recording never takes a lock; readers
+ * sum the blocks of all threads when a snapshot is requested.
+ */
+class Profiler {
+public:
+	struct Summary {
+		std::string name;
+		bool timer;
+		sf::Uint64 count;
+		sf::Uint64 total;
+		sf::Uint64 max;
+		sf::Uint64 p50;
+		sf::Uint64 p99;
+	};
+
+	class ScopedTimer {
+	public:
+		inline explicit ScopedTimer(unsigned int id) :
+				id(id), start(Now()) {
+		}
+		inline ~ScopedTimer() {
+			Record(id, Now() - start);
+		}
+	private:
+		unsigned int id;
+		sf::Int64 start;
+	};
+
+	static unsigned int Register(const char * name, bool timer);
+
+	static inline sf::Int64 Now() {
+		return clock.getElapsedTime().asMicroseconds();
+	}
+
+	static inline void Record(unsigned int id, sf::Int64 value) {
+		ThreadStats * stats = localStats;
+		if (stats == NULL) {
+			stats = localStats = RegisterThread();
+		}
+
+		sf::Uint64 v = value < 0 ? 0 : value;
+		unsigned int bucket = 0;
+		while (bucket < PROFILE_BUCKETS - 1 && (v >> bucket) > 0) {
+			bucket++;
+		}
+
+		// Only this thread writes its block, so plain load/store is enough
+		Stat& stat = stats->stats[id];
+		stat.count.store(stat.count.load(std::memory_order_relaxed) + 1,
+				std::memory_order_relaxed);
+		stat.total.store(stat.total.load(std::memory_order_relaxed) + v,
+				std::memory_order_relaxed);
+		if (v > stat.max.load(std::memory_order_relaxed)) {
+			stat.max.store(v, std::memory_order_relaxed);
+		}
+		stat.buckets[bucket].store(
+				stat.buckets[bucket].load(std::memory_order_relaxed) + 1,
+				std::memory_order_relaxed);
+	}
+
+	static void Snapshot(std::vector<Summary>& out);
+	static bool Dump(const std::string& file);
+
+private:
+	struct Stat {
+		std::atomic<sf::Uint64> count;
+		std::atomic<sf::Uint64> total;
+		std::atomic<sf::Uint64> max;
+		std::atomic<sf::Uint32> buckets[PROFILE_BUCKETS];
+	};
+
+	struct ThreadStats {
+		Stat stats[PROFILE_MAX_STATS];
+	};
+
+	static sf::Clock clock;
+	static thread_local ThreadStats * localStats;
+	static std::vector<ThreadStats *> threads;
+	static const char * names[PROFILE_MAX_STATS];
+	static bool timers[PROFILE_MAX_STATS];
+	static std::atomic<unsigned int> statCount;
+	static sf::Mutex mutex_registry;
+
+	static ThreadStats * RegisterThread();
+	static sf::Uint64 Percentile(const sf::Uint64 * buckets, sf::Uint64 count,
+			double fraction);
+};
+
+}
+
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+
+#if defined(PROFILE) and PROFILE == 1
+// Times the rest of the enclosing scope
+#define PROFILE_SCOPE(name) \
+	static const unsigned int PROFILE_CONCAT(profileId_, __LINE__) = \
+			trickfire::Profiler::Register(name, true); \
+	trickfire::Profiler::ScopedTimer PROFILE_CONCAT(profileTimer_, __LINE__)( \
+			PROFILE_CONCAT(profileId_, __LINE__))
+
+// Adds n to a named counter
+#define PROFILE_COUNT(name, n) \
+	do { \
+		static const unsigned int profileId = \
+				trickfire::Profiler::Register(name, false); \
+		trickfire::Profiler::Record(profileId, n); \
+	} while (0)
+
+// Records a duration in microseconds measured some other way
+#define PROFILE_SAMPLE(name, us) \
+	do { \
+		static const unsigned int profileId = \
+				trickfire::Profiler::Register(name, true); \
+		trickfire::Profiler::Record(profileId, us); \
+	} while (0)
+#else
+#define PROFILE_SCOPE(name)
+// sizeof keeps the values "used" without evaluating them
+#define PROFILE_COUNT(name, n) do { (void) sizeof(n); } while (0)
+#define PROFILE_SAMPLE(name, us) do { (void) sizeof(us); } while (0)
+#endif
+
+#endif
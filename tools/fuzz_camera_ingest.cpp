@@ -0,0 +1,144 @@
+/**
+ * Fuzz harness for the received packet path, CameraIngest::ReadPacket, which
+ * is what PacketReceived hands every packet from the robot to. Each input is
+ * one packet: back to back messages, each starting with its Int32 type, so
+ * the type dispatch, unknown types, the frame lock and the per-frame callback
+ * are all exercised along with the frame validation. Frame buffers persist
+ * between inputs, so a sequence of inputs also checks that no buffer ever
+ * grows past its cap.
+ *
+ * With libFuzzer, from the repository root:
+ *   clang++ -std=c++11 -g -O1 -fsanitize=fuzzer,address,undefined -Isrc \
+ *       -I<TrickFire networking include dir> `pkg-config --cflags opencv` \
+ *       tools/fuzz_camera_ingest.cpp src/CameraIngest.cpp src/AsyncLog.cpp \
+ *       src/Profiler.cpp src/AllocCounter.cpp `pkg-config --libs opencv` \
+ *       -lsfml-system -o fuzz_camera_ingest
+ *   ./fuzz_camera_ingest
+ *
+ * Without libFuzzer, add -DFUZZ_STANDALONE and drop -fsanitize=fuzzer to get a
+ * driver that feeds it random well formed, corrupted and truncated packets:
+ *   g++ -std=c++11 -g -O1 -fsanitize=address,undefined -DFUZZ_STANDALONE \
+ *       -Isrc -I<TrickFire networking include dir> \
+ *       `pkg-config --cflags opencv` tools/fuzz_camera_ingest.cpp \
+ *       src/CameraIngest.cpp src/AsyncLog.cpp src/Profiler.cpp \
+ *       src/AllocCounter.cpp `pkg-config --libs opencv` -lsfml-system \
+ *       -o fuzz_camera_ingest
+ *   ./fuzz_camera_ingest [iterations]
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "AsyncLog.h"
+#include "CameraIngest.h"
+#include "PacketReader.h"
+#include "NetworkingConstants.h"
+
+using namespace trickfire;
+
+// Kept small so the fuzzer can reach valid frames
+#define FUZZ_MAX_COLS 64
+#define FUZZ_MAX_ROWS 48
+#define FUZZ_CAP (FUZZ_MAX_COLS * FUZZ_MAX_ROWS * CAM_BYTES_PER_PIXEL)
+
+static cv::Mat frames[CAM_COUNT];
+static sf::Mutex mutex_frames;
+static size_t consumed;
+
+static void FrameReceived(int cam) {
+	if (cam < 0 || cam >= CAM_COUNT) {
+		fprintf(stderr, "callback for camera %d\n", cam);
+		abort();
+	}
+
+	// Type, camera, rows, cols and the pixels
+	consumed += 16 + (size_t) frames[cam].rows * frames[cam].cols * 3;
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t * data, size_t size) {
+	static bool configured = false;
+	if (!configured) {
+		AsyncLog::SetLevel(AsyncLog::LEVEL_OFF);
+		CameraIngest::SetMaxResolution(FUZZ_MAX_COLS, FUZZ_MAX_ROWS);
+		// Camera 0 gets a tighter cap than the resolution allows
+		CameraIngest::SetMemoryCap(0, FUZZ_CAP / 2);
+		configured = true;
+	}
+
+	PacketReader reader(data, size);
+	consumed = 0;
+	CameraIngest::Result result = CameraIngest::ReadPacket(reader, frames,
+			mutex_frames, FrameReceived);
+
+	// A packet that was accepted whole is exactly its frames, nothing more
+	if (result == CameraIngest::RESULT_OK && consumed != size) {
+		fprintf(stderr, "accepted %zu byte packet but frames cover %zu\n",
+				size, consumed);
+		abort();
+	}
+
+	for (int i = 0; i < CAM_COUNT; i++) {
+		size_t bytes = (size_t) frames[i].rows * frames[i].cols
+				* CAM_BYTES_PER_PIXEL;
+		size_t cap = i == 0 ? FUZZ_CAP / 2 : FUZZ_CAP;
+		if (bytes > cap) {
+			fprintf(stderr, "camera %d buffer is %zu bytes, cap %zu\n", i,
+					bytes, cap);
+			abort();
+		}
+	}
+
+	return 0;
+}
+
+#ifdef FUZZ_STANDALONE
+static void PutInt32(std::vector<uint8_t>& packet, int32_t value) {
+	uint32_t raw = htonl(value);
+	const uint8_t * bytes = (const uint8_t *) &raw;
+	packet.insert(packet.end(), bytes, bytes + sizeof(raw));
+}
+
+int main(int argc, char ** argv) {
+	long iterations = argc > 1 ? atol(argv[1]) : 200000;
+	srand(1);
+
+	for (long it = 0; it < iterations; it++) {
+		std::vector<uint8_t> packet;
+		int messages = 1 + rand() % 3;
+		for (int m = 0; m < messages; m++) {
+			// Mostly camera messages with plausible headers, sometimes
+			// another type or anything at all
+			PutInt32(packet, rand() % 10 == 0 ? rand() % 8 : CAMERA_PACKET);
+			int kind = rand() % 4;
+			int32_t cam = kind == 0 ? rand() - RAND_MAX / 2 :
+							rand() % (CAM_COUNT + 2) - 1;
+			int32_t rows = kind == 1 ? rand() - RAND_MAX / 2 :
+							rand() % (FUZZ_MAX_ROWS + 12) - 4;
+			int32_t cols = kind == 1 ? rand() - RAND_MAX / 2 :
+							rand() % (FUZZ_MAX_COLS + 16) - 4;
+			PutInt32(packet, cam);
+			PutInt32(packet, rows);
+			PutInt32(packet, cols);
+
+			size_t body = rows > 0 && cols > 0 && rows < 1000 && cols < 1000 ?
+							(size_t) rows * cols * 3 : rand() % 100;
+			if (rand() % 3 == 0) {
+				body = rand() % (body + 1);
+			}
+			for (size_t i = 0; i < body; i++) {
+				packet.push_back(rand());
+			}
+		}
+
+		if (rand() % 5 == 0) {
+			packet.resize(rand() % (packet.size() + 1));
+		}
+
+		LLVMFuzzerTestOneInput(packet.data(), packet.size());
+	}
+
+	printf("%ld packets, no errors\n", iterations);
+	return 0;
+}
+#endif
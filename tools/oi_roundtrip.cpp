@@ -0,0 +1,88 @@
+/**
+ * Round trip check for the OI v2 protocol: encodes random button payloads
+ * with OIParser::Encode, corrupts some of them and injects line noise between
+ * others, and feeds the bytes back through OIParser. Every frame that arrived
+ * intact must decode to exactly what was sent, and the parser must recover
+ * after every bad frame.
+ *
+ * From the repository root:
+ *   g++ -std=c++11 -g -O1 -fsanitize=address,undefined -Isrc \
+ *       -I<SFML include dir> tools/oi_roundtrip.cpp src/OIProtocol.cpp \
+ *       -o oi_roundtrip
+ *   ./oi_roundtrip [iterations]
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "OIProtocol.h"
+
+using namespace trickfire;
+
+int main(int argc, char ** argv) {
+	long iterations = argc > 1 ? atol(argv[1]) : 200000;
+	srand(3);
+
+	OIParser parser;
+	unsigned long long intact = 0, decoded = 0, rejected = 0;
+
+	for (long it = 0; it < iterations; it++) {
+		// Lots of 0x00 and 0xFF, the bytes the old protocol choked on
+		sf::Uint8 payload[OI_MAX_PAYLOAD];
+		unsigned int size = 1 + rand() % OI_MAX_PAYLOAD;
+		for (unsigned int i = 0; i < size; i++) {
+			int pick = rand() % 3;
+			payload[i] = pick == 0 ? 0 : pick == 1 ? 0xFF : rand();
+		}
+
+		sf::Uint8 frame[OI_MAX_ENCODED_FRAME + 1];
+		unsigned int encoded = OIParser::Encode(payload, size, (sf::Uint8) it,
+				frame);
+
+		bool corrupted = rand() % 10 == 0;
+		if (corrupted) {
+			frame[rand() % (encoded - 1)] = rand();
+		}
+
+		// Noise before a frame can eat it, so only frames sent right after a
+		// clean delimiter count as intact
+		bool noisy = rand() % 50 == 0;
+		if (noisy) {
+			for (int i = 0; i < 30; i++) {
+				parser.Push(rand());
+			}
+		}
+
+		bool gotFrame = false;
+		for (unsigned int i = 0; i < encoded; i++) {
+			OIParser::Result result = parser.Push(frame[i]);
+			if (result == OIParser::RESULT_FRAME) {
+				gotFrame = true;
+				decoded++;
+				if (!corrupted
+						&& (parser.GetPayloadSize() != size
+								|| memcmp(parser.GetPayload(), payload, size)
+										!= 0)) {
+					fprintf(stderr, "frame %ld decoded wrong\n", it);
+					return 1;
+				}
+			} else if (result != OIParser::RESULT_NONE) {
+				rejected++;
+			}
+		}
+
+		if (!corrupted && !noisy) {
+			intact++;
+			if (!gotFrame) {
+				fprintf(stderr, "intact frame %ld was dropped\n", it);
+				return 1;
+			}
+		}
+	}
+
+	printf("%ld frames: %llu intact, %llu decoded, %llu rejected, "
+			"%llu errors, %llu lost\n", iterations, intact, decoded, rejected,
+			parser.GetErrorCount(), parser.GetLostCount());
+	return 0;
+}
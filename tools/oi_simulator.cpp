@@ -0,0 +1,117 @@
+/**
+ * Stands in for the OI on a pseudo terminal, streaming protocol v2 frames as
+ * fast as the reader takes them (or at a fixed rate) so the driver station's
+ * OI parser can be exercised without the hardware. Prints the pty path to
+ * pass to the driver station with --oi-port.
+ *
+ * From the repository root:
+ *   g++ -std=c++11 -O2 -Isrc -I<SFML include dir> tools/oi_simulator.cpp \
+ *       src/OIProtocol.cpp -o oi_simulator
+ *   ./oi_simulator [frames per second, 0 for unlimited] [corrupt percent]
+ */
+
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "OIProtocol.h"
+
+using namespace trickfire;
+
+static volatile sig_atomic_t running = 1;
+
+static void Stop(int) {
+	running = 0;
+}
+
+static double Now() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char ** argv) {
+	double rate = argc > 1 ? atof(argv[1]) : 0;
+	int corrupt = argc > 2 ? atoi(argv[2]) : 0;
+
+	int master = posix_openpt(O_RDWR | O_NOCTTY);
+	if (master == -1 || grantpt(master) != 0 || unlockpt(master) != 0) {
+		perror("posix_openpt");
+		return 1;
+	}
+
+	// Raw mode on our side too, so 0x00 and friends pass through untouched
+	struct termios tio;
+	tcgetattr(master, &tio);
+	cfmakeraw(&tio);
+	tcsetattr(master, TCSANOW, &tio);
+
+	printf("%s\n", ptsname(master));
+	fflush(stdout);
+
+	signal(SIGINT, Stop);
+	signal(SIGTERM, Stop);
+
+	sf::Uint8 buttons[3] = { 0, 0, 0 };
+	sf::Uint8 sequence = 0;
+	unsigned long long frames = 0;
+	double start = Now();
+	double report = start;
+
+	while (running) {
+		// Flip a random button now and then so there are edges to see
+		if (rand() % 16 == 0) {
+			int button = rand() % 24;
+			buttons[button / 8] ^= 1 << (button % 8);
+		}
+
+		sf::Uint8 frame[OI_MAX_ENCODED_FRAME + 1];
+		unsigned int size = OIParser::Encode(buttons, sizeof(buttons),
+				sequence++, frame);
+		if (corrupt > 0 && rand() % 100 < corrupt) {
+			frame[rand() % (size - 1)] ^= 1 << (rand() % 8);
+		}
+
+		// Wait for room rather than spinning when nobody is reading
+		struct pollfd pfd;
+		pfd.fd = master;
+		pfd.events = POLLOUT;
+		if (poll(&pfd, 1, 100) <= 0 || !(pfd.revents & POLLOUT)) {
+			continue;
+		}
+
+		unsigned int written = 0;
+		while (written < size && running) {
+			ssize_t count = write(master, frame + written, size - written);
+			if (count < 0 && errno != EAGAIN && errno != EINTR) {
+				perror("write");
+				return 1;
+			}
+			written += count > 0 ? count : 0;
+		}
+		frames++;
+
+		double now = Now();
+		if (now - report >= 1.0) {
+			fprintf(stderr, "%llu frames, %.0f frames/s\n", frames,
+					frames / (now - start));
+			report = now;
+		}
+
+		if (rate > 0) {
+			double next = start + frames / rate;
+			if (next > now) {
+				usleep((useconds_t) ((next - now) * 1e6));
+			}
+		}
+	}
+
+	close(master);
+	return 0;
+}
@@ -0,0 +1,265 @@
+/**
+ * Stands in for the robot so the driver station's networking path can be
+ * driven without it. Connects to the driver station (port 25565), drains and
+ * counts the command packets it sends, and reports rates every second.
+ *
+ * --echo answers every command with a packet carrying the command type and
+ * the time it arrived here (microseconds since start, high and low Int32).
+ * The driver station has no handler for it and drops it as an unknown type,
+ * so it loads the receive path and gives each send a timestamped reply to
+ * line up against a capture. --camera COLS ROWS also sends a test pattern
+ * frame for camera 0 about 30 times a second, to exercise camera ingest.
+ *
+ * Packets use the sf::Packet framing over TCP: an Int32 length in network
+ * order, then the payload.
+ *
+ * From the repository root:
+ *   g++ -std=c++11 -O2 -I<TrickFire networking include dir> \
+ *       tools/robot_standin.cpp -o robot_standin
+ *   ./robot_standin [--host ADDRESS] [--port PORT] [--echo]
+ *       [--camera COLS ROWS]
+ */
+
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "NetworkingConstants.h"
+
+// Not a type the driver station knows
+#define ECHO_PACKET -1
+#define TYPE_COUNT 16
+
+static volatile sig_atomic_t running = 1;
+
+static void Stop(int) {
+	running = 0;
+}
+
+static long long NowMicros() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+}
+
+static void PutInt32(std::vector<unsigned char>& out, int value) {
+	unsigned int raw = htonl(value);
+	out.insert(out.end(), (unsigned char *) &raw,
+			(unsigned char *) &raw + sizeof(raw));
+}
+
+static bool SendAll(int fd, const unsigned char * data, size_t size) {
+	while (size > 0) {
+		ssize_t count = send(fd, data, size, MSG_NOSIGNAL);
+		if (count < 0 && errno == EINTR) {
+			continue;
+		}
+		if (count <= 0) {
+			return false;
+		}
+		data += count;
+		size -= count;
+	}
+	return true;
+}
+
+static bool SendPacket(int fd, const std::vector<unsigned char>& payload) {
+	std::vector<unsigned char> frame;
+	PutInt32(frame, payload.size());
+	frame.insert(frame.end(), payload.begin(), payload.end());
+	return SendAll(fd, frame.data(), frame.size());
+}
+
+static int Connect(const std::string& host, int port) {
+	int fd = socket(AF_INET, SOCK_STREAM, 0);
+	if (fd < 0) {
+		return -1;
+	}
+
+	struct sockaddr_in address;
+	memset(&address, 0, sizeof(address));
+	address.sin_family = AF_INET;
+	address.sin_port = htons(port);
+	if (inet_pton(AF_INET, host.c_str(), &address.sin_addr) != 1
+			|| connect(fd, (struct sockaddr *) &address, sizeof(address))
+					!= 0) {
+		close(fd);
+		return -1;
+	}
+
+	// Commands are small, don't let them sit in Nagle's buffer
+	int one = 1;
+	setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+	return fd;
+}
+
+int main(int argc, char ** argv) {
+	std::string host = "127.0.0.1";
+	int port = 25565;
+	bool echo = false;
+	int cameraCols = 0, cameraRows = 0;
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if (arg == "--host" && i + 1 < argc) {
+			host = argv[++i];
+		} else if (arg == "--port" && i + 1 < argc) {
+			port = atoi(argv[++i]);
+		} else if (arg == "--echo") {
+			echo = true;
+		} else if (arg == "--camera" && i + 2 < argc) {
+			cameraCols = atoi(argv[++i]);
+			cameraRows = atoi(argv[++i]);
+		} else {
+			fprintf(stderr, "Unknown argument %s\n", arg.c_str());
+			return 1;
+		}
+	}
+
+	signal(SIGINT, Stop);
+	signal(SIGTERM, Stop);
+
+	std::vector<unsigned char> frame;
+	if (cameraCols > 0 && cameraRows > 0) {
+		PutInt32(frame, CAMERA_PACKET);
+		PutInt32(frame, 0);
+		PutInt32(frame, cameraRows);
+		PutInt32(frame, cameraCols);
+		for (int y = 0; y < cameraRows; y++) {
+			for (int x = 0; x < cameraCols; x++) {
+				frame.push_back(x * 255 / cameraCols);
+				frame.push_back(y * 255 / cameraRows);
+				frame.push_back(128);
+			}
+		}
+	}
+
+	long long start = NowMicros();
+	unsigned long long packets = 0, bytes = 0, frames = 0;
+	unsigned long long types[TYPE_COUNT] = { 0 };
+
+	while (running) {
+		int fd = Connect(host, port);
+		if (fd < 0) {
+			// The driver station may not be up yet
+			sleep(1);
+			continue;
+		}
+		printf("Connected to %s:%d\n", host.c_str(), port);
+		fflush(stdout);
+
+		std::vector<unsigned char> buffer;
+		long long reportTime = NowMicros(), nextFrame = reportTime;
+		unsigned long long reportPackets = 0, reportBytes = 0;
+		long long lastPacket = 0, maxGap = 0;
+
+		while (running) {
+			struct pollfd pfd;
+			pfd.fd = fd;
+			pfd.events = POLLIN;
+			if (poll(&pfd, 1, 10) < 0 && errno != EINTR) {
+				break;
+			}
+
+			if (pfd.revents & (POLLIN | POLLHUP | POLLERR)) {
+				unsigned char chunk[4096];
+				ssize_t count = recv(fd, chunk, sizeof(chunk), 0);
+				if (count <= 0) {
+					break;
+				}
+				buffer.insert(buffer.end(), chunk, chunk + count);
+			}
+
+			// Take every whole packet out of what has arrived so far
+			size_t offset = 0;
+			while (buffer.size() - offset >= 4) {
+				unsigned int size;
+				memcpy(&size, &buffer[offset], 4);
+				size = ntohl(size);
+				if (buffer.size() - offset - 4 < size) {
+					break;
+				}
+
+				long long now = NowMicros();
+				int type = -1;
+				if (size >= 4) {
+					unsigned int raw;
+					memcpy(&raw, &buffer[offset + 4], 4);
+					type = (int) ntohl(raw);
+				}
+				if (type >= 0 && type < TYPE_COUNT) {
+					types[type]++;
+				}
+				if (lastPacket != 0 && now - lastPacket > maxGap) {
+					maxGap = now - lastPacket;
+				}
+				lastPacket = now;
+				packets++;
+				bytes += size;
+
+				if (echo) {
+					std::vector<unsigned char> reply;
+					PutInt32(reply, ECHO_PACKET);
+					PutInt32(reply, type);
+					PutInt32(reply, (int) ((now - start) >> 32));
+					PutInt32(reply, (int) ((now - start) & 0xFFFFFFFF));
+					if (!SendPacket(fd, reply)) {
+						break;
+					}
+				}
+
+				offset += 4 + size;
+			}
+			buffer.erase(buffer.begin(), buffer.begin() + offset);
+
+			long long now = NowMicros();
+			if (!frame.empty() && now >= nextFrame) {
+				if (!SendPacket(fd, frame)) {
+					break;
+				}
+				frames++;
+				nextFrame += 1000000 / 30;
+			}
+
+			if (now - reportTime >= 1000000) {
+				double seconds = (now - reportTime) / 1000000.0;
+				printf("%.0f packets/s, %.0f bytes/s, max gap %lld us, "
+						"%llu frames sent\n",
+						(packets - reportPackets) / seconds,
+						(bytes - reportBytes) / seconds, maxGap, frames);
+				fflush(stdout);
+				reportTime = now;
+				reportPackets = packets;
+				reportBytes = bytes;
+				maxGap = 0;
+			}
+		}
+
+		close(fd);
+		if (running) {
+			printf("Disconnected, retrying\n");
+			fflush(stdout);
+			sleep(1);
+		}
+	}
+
+	printf("%llu packets, %llu bytes, %llu frames sent. By type:", packets,
+			bytes, frames);
+	for (int i = 0; i < TYPE_COUNT; i++) {
+		if (types[i] > 0) {
+			printf(" %d=%llu", i, types[i]);
+		}
+	}
+	printf("\n");
+	return 0;
+}